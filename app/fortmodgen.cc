@@ -1,54 +1,258 @@
 #include "CInterfaceGenerator.h"
 #include "FortranModuleGenerator.h"
+#include "resolve.h"
 #include "types.h"
+#include "utils.h"
 
+#include "fmt/core.h"
 #include "toml.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <cctype>
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
 #include <string>
+#include <thread>
 
 void Usage(char const *argv[]) {
-  std::cout << "[USAGE]: " << argv[0] << std::endl;
+  std::cout << "[USAGE]: " << argv[0]
+            << " -i <descriptor.toml> -o <output stub> [-i ... -o ...]\n"
+               "          [--batch <manifest>] [-j <threads>] "
+               "[--layout-report] [--split-modules]\n"
+               "          [--print-module-name] [--print-outputs] "
+               "[--stamp <file>] [--depfile <file>]"
+            << std::endl;
 }
 
-std::string fin, outstub;
+// descriptor and output stub pairs, generated in the order given
+std::vector<std::pair<std::string, std::string>> jobs;
+bool layout_report = false;
+bool split_modules = false;
+int nthreads = 0;
+// threads that render the types of one descriptor, the rest of the -j budget
+// goes to processing several descriptors at once
+int emit_threads = 1;
+// introspection modes print information about the descriptors instead of
+// generating anything
+bool print_module_name = false;
+bool print_outputs = false;
+// written after successful generation, the depfile lists the inputs of the
+// stamp, or of the generated files without a stamp
+std::string stamp;
+std::string depfile;
+std::vector<std::string> manifests;
+
+int const kCacheLineSize = 64;
+
+// A batch manifest lists one descriptor and its output stub per line,
+// separated by whitespace. Blank lines and lines starting with # are skipped.
+void ReadManifest(std::string const &manifest, std::vector<std::string> &fins,
+                  std::vector<std::string> &outstubs) {
+  std::ifstream file(manifest);
+  if (!file) {
+    std::cerr << "[ERROR]: Failed to open batch manifest: " << manifest
+              << std::endl;
+    exit(1);
+  }
+  std::string line;
+  for (int lineno = 1; std::getline(file, line); ++lineno) {
+    std::stringstream ss(line);
+    std::string fin, outstub, extra;
+    if (!(ss >> fin) || (fin.front() == '#')) {
+      continue;
+    }
+    if (!(ss >> outstub) || (ss >> extra)) {
+      std::cerr << "[ERROR]: " << manifest << ":" << lineno
+                << ": expected a descriptor and an output stub, found: "
+                << line << std::endl;
+      exit(1);
+    }
+    fins.push_back(fin);
+    outstubs.push_back(outstub);
+  }
+}
 
 void ParseOpts(int argc, char const *argv[]) {
+  std::vector<std::string> fins, outstubs;
   for (int opt_it = 1; opt_it < argc; opt_it++) {
     std::string arg = argv[opt_it];
     if ((arg == "-h") || (arg == "-?") || (arg == "--help")) {
       Usage(argv);
       exit(0);
+    } else if (arg == "--layout-report") {
+      layout_report = true;
+    } else if (arg == "--split-modules") {
+      split_modules = true;
+    } else if (arg == "--print-module-name") {
+      print_module_name = true;
+    } else if (arg == "--print-outputs") {
+      print_outputs = true;
     } else if ((opt_it + 1) < argc) {
       if (arg == "-i") {
-        fin = argv[++opt_it];
+        fins.push_back(argv[++opt_it]);
       } else if (arg == "-o") {
-        outstub = argv[++opt_it];
+        outstubs.push_back(argv[++opt_it]);
+      } else if (arg == "--batch") {
+        manifests.push_back(argv[++opt_it]);
+        ReadManifest(manifests.back(), fins, outstubs);
+      } else if (arg == "-j") {
+        nthreads = std::atoi(argv[++opt_it]);
+      } else if (arg == "--stamp") {
+        stamp = argv[++opt_it];
+      } else if (arg == "--depfile") {
+        depfile = argv[++opt_it];
       }
     }
   }
-  if (!fin.size() || !outstub.length()) {
-    std::cerr << "[ERROR]: Not all required options recieved: (-i, -o)."
+  bool needs_outstubs = !(layout_report || print_module_name);
+  if (!fins.size() || ((outstubs.size() != fins.size()) && needs_outstubs)) {
+    std::cerr << "[ERROR]: Not all required options recieved: (-i, -o), "
+                 "every descriptor needs an output stub."
               << std::endl;
     Usage(argv);
     exit(1);
   }
+  for (size_t i = 0; i < fins.size(); ++i) {
+    jobs.emplace_back(fins[i], (i < outstubs.size()) ? outstubs[i] : "");
+  }
 }
 
-int main(int argc, char const *argv[]) {
-  ParseOpts(argc, argv);
+// Size, field offsets, padding and cache line usage of a derived type
+void LayoutReport(std::ostream &os, std::string const &dtypename,
+                  DerivedType const &dtype) {
+  auto dtl = GetLayout(dtype);
 
-  toml::value fmod_descriptor;
+  os << fmt::format("{}{}:\n  size: {} bytes, alignment: {} bytes, padding: {} "
+             "bytes, cache lines: {}\n",
+             dtypename, dtype.pack ? " (packed)" : "", dtl.size, dtl.alignment,
+             dtl.get_padding(), (dtl.size + kCacheLineSize - 1) / kCacheLineSize);
+  if (dtype.is_instance_array()) {
+    os << fmt::format("  instances: {}, total size: {} bytes\n", dtype.instances,
+               dtype.instances * dtl.size);
+  }
+
+  os << fmt::format("  {:>8} {:>8} {:>8}  {}\n", "offset", "size", "padding",
+             "field");
+  int line = -1;
+  for (size_t i = 0; i < dtl.fields.size(); ++i) {
+    auto const &fl = dtl.fields[i];
+    if ((fl.offset / kCacheLineSize) != line) {
+      line = fl.offset / kCacheLineSize;
+      os << fmt::format("  -- cache line {} (offset {})\n", line,
+                 line * kCacheLineSize);
+    }
+    int last_line = (fl.offset + fl.size - 1) / kCacheLineSize;
+    os << fmt::format("  {:>8} {:>8} {:>8}  {}{}\n", fl.offset, fl.size, fl.padding,
+               to_string(dtype.fields[i]),
+               (last_line != line)
+                   ? fmt::format(" (spans {} cache lines)", last_line - line + 1)
+                   : "");
+    line = last_line;
+  }
+  if (dtl.tail_padding) {
+    os << fmt::format("  {:>8} {:>8} {:>8}  <tail padding>\n",
+               dtl.size - dtl.tail_padding, "", dtl.tail_padding);
+  }
+
+  if (!dtype.pack) {
+    DerivedType packed = dtype;
+    PackFields(packed);
+    auto packed_size = GetLayout(packed).size;
+    if (packed_size < dtl.size) {
+      os << fmt::format("  set pack = true to reorder the fields and save {} bytes\n",
+                 dtl.size - packed_size);
+    }
+  }
+  os << fmt::format("\n");
+}
+
+// The module table of the descriptor in fin
+toml::value ParseDescriptor(std::string const &fin) {
   try {
     auto doc = toml::parse(fin);
-    fmod_descriptor = toml::find(doc, "module");
+    return toml::find(doc, "module");
   } catch (std::runtime_error const &e) {
-    std::cout << "[ERROR]: Failed to parse toml file: " << fin
-              << ", with error: " << e.what() << std::endl;
-    abort();
+    Error("Failed to parse toml file: ", fin, ", with error: ", e.what());
+  }
+}
+
+// The files generated for fin, without generating them
+std::vector<std::string> GetOutputs(std::string const &fin,
+                                    std::string const &outstub) {
+  auto descriptor = ParseDescriptor(fin);
+  auto dtypenames =
+      toml::find<std::vector<std::string>>(descriptor, "derivedtypes");
+  bool shared_memory = false, seqlock = false;
+  for (auto const &dtypename : dtypenames) {
+    auto const &dtype = toml::find(descriptor, dtypename);
+    shared_memory |=
+        (toml::find_or<InstanceStorage>(dtype, "storage",
+                                        InstanceStorage::kStatic) ==
+         InstanceStorage::kSharedMemory);
+    seqlock |= (toml::find_or<ConcurrencyMode>(dtype, "concurrency",
+                                               ConcurrencyMode::kNone) ==
+                ConcurrencyMode::kSeqLock);
+  }
+  auto files = FortranModuleFiles(outstub, dtypenames, split_modules,
+                                  shared_memory, seqlock);
+  auto cfiles = CInterfaceFiles(outstub);
+  files.insert(files.end(), cfiles.begin(), cfiles.end());
+  return files;
+}
+
+// Make syntax only needs spaces, # and $ escaped in file names
+std::string DepfileEscape(std::string const &path) {
+  std::string escaped;
+  for (char c : path) {
+    if ((c == ' ') || (c == '#')) {
+      escaped += '\\';
+    } else if (c == '$') {
+      escaped += '$';
+    }
+    escaped += c;
+  }
+  return escaped;
+}
+
+// Records the inputs of this run for build systems, the targets are the stamp
+// or the generated files
+void WriteDepfile() {
+  std::vector<std::string> targets = {stamp};
+  if (stamp.empty()) {
+    targets.clear();
+    for (auto const &job : jobs) {
+      auto files = GetOutputs(job.first, job.second);
+      targets.insert(targets.end(), files.begin(), files.end());
+    }
   }
+  std::vector<std::string> inputs = manifests;
+  for (auto const &job : jobs) {
+    inputs.push_back(job.first);
+  }
+
+  OutputBuffer out;
+  for (size_t i = 0; i < targets.size(); ++i) {
+    out.print("{}{}", i ? " " : "", DepfileEscape(targets[i]));
+  }
+  out.print(":");
+  for (auto const &input : inputs) {
+    out.print(" \\\n  {}", DepfileEscape(input));
+  }
+  out.print("\n");
+  out.WriteIfChanged(depfile);
+}
+
+// Generates the module described by fin, with progress written to log.
+// Descriptors are independent, so several can be processed concurrently.
+void ProcessDescriptor(std::string const &fin, std::string const &outstub,
+                       std::ostream &log) {
+
+  toml::value fmod_descriptor = ParseDescriptor(fin);
 
   std::string modname = toml::find<std::string>(fmod_descriptor, "name");
   auto dtypenames =
@@ -61,67 +265,273 @@ int main(int argc, char const *argv[]) {
   auto Uses =
       toml::find_or<std::vector<std::string>>(fmod_descriptor, "uses", {});
 
-  std::cout << "Found module descriptor for module: " << modname << " with "
+  // parameters are folded to literals once, everything that refers to them
+  // is resolved through the symbol table
+  SymbolTable symbols = ResolveParameters(ParameterFieldDescriptors);
+
+  log << "Found module descriptor for module: " << modname << " with "
             << dtypenames.size() << " defined derived types and "
             << ParameterFieldDescriptors.size() << " parameters." << std::endl
             << std::endl;
 
-  std::cout << "Parameters: " << std::endl;
+  log << "Parameters: " << std::endl;
   for (auto const &p : ParameterFieldDescriptors) {
-    std::cout << "  " << p << std::endl;
+    log << "  " << p << std::endl;
   }
 
-  std::cout << std::endl << "Derived types: " << std::endl;
+  log << std::endl << "Derived types: " << std::endl;
 
+  // types are kept in descriptor order so that the generated files do not
+  // depend on anything but the descriptor
   DerivedTypes TypeFieldDescriptors;
   for (auto const &dtypename : dtypenames) {
-    std::cout << "\t" << dtypename << std::endl;
+    log << "\t" << dtypename << std::endl;
     auto dtype_table = toml::find(fmod_descriptor, dtypename);
 
-    TypeFieldDescriptors[dtypename].comment =
-        toml::find_or<std::string>(dtype_table, "comment", "");
+    for (auto const &dt : TypeFieldDescriptors) {
+      if (dt.first == dtypename) {
+        Error("Type \"", dtypename, "\" is listed more than once in "
+              "derivedtypes.");
+      }
+    }
+    auto &dtype =
+        TypeFieldDescriptors.emplace_back(dtypename, DerivedType{}).second;
+
+    dtype.comment = toml::find_or<std::string>(dtype_table, "comment", "");
+    dtype.concurrency = toml::find_or<ConcurrencyMode>(
+        dtype_table, "concurrency", ConcurrencyMode::kNone);
+    dtype.threadprivate =
+        toml::find_or<bool>(dtype_table, "threadprivate", false);
+    dtype.pack = toml::find_or<bool>(dtype_table, "pack", false);
+    dtype.storage = toml::find_or<InstanceStorage>(dtype_table, "storage",
+                                                   InstanceStorage::kStatic);
+
+    if (dtype.is_shared() && (dtype.threadprivate || dtype.is_seqlocked())) {
+      Error("Type \"", dtypename, "\" uses shared memory storage, so it cannot "
+            "also be threadprivate or use a concurrency mode, which are "
+            "per-process.");
+    }
+    dtype.align = toml::find_or<int>(dtype_table, "align", 0);
+
+    int type_align = dtype.align;
+    if ((type_align < 0) || (type_align & (type_align - 1))) {
+      Error("Type \"", dtypename, "\" has align = ", type_align, ", which is "
+            "not a power of two number of bytes.");
+    }
+
+    if (dtype.threadprivate && dtype.is_seqlocked()) {
+      Error("Type \"", dtypename, "\" is threadprivate, so it cannot also use "
+            "a concurrency mode as its instances are never shared.");
+    }
+
+    std::variant<int, std::string> instances_dim = 0;
+    if (dtype_table.contains("instances")) {
+      auto instances_element = toml::find(dtype_table, "instances");
+      if (instances_element.is_integer()) {
+        instances_dim = toml::get<int>(instances_element);
+      } else if (instances_element.is_string()) {
+        instances_dim = toml::get<std::string>(instances_element);
+      }
+      dtype.instances = ResolveExtent(
+          instances_dim, symbols, fmt::format("Type \"{}\"", dtypename));
+      if (dtype.instances < 1) {
+        Error("Type \"", dtypename, "\" has invalid instances option, expected "
+              "a positive integer or an integer parameter expression.");
+      }
+      dtype.layout = toml::find_or<InstanceLayout>(
+          dtype_table, "layout", InstanceLayout::kArrayOfStructs);
+      if (dtype.threadprivate) {
+        Error("Type \"", dtypename, "\" is threadprivate, so it cannot also "
+              "declare multiple instances.");
+      }
+    }
 
     for (auto const &fd :
          toml::find<std::vector<FieldDescriptor>>(dtype_table, "fields")) {
-      TypeFieldDescriptors[dtypename].fields.push_back(fd);
-      std::cout << "\t\t" << fd << std::endl;
-
-      if (fd.size.size()) {
-        for (auto const &dim : fd.size) {
-
-          if (dim.index() == FieldDescriptor::kSizeString) {
-
-            bool found = false;
-            for (auto const &p : ParameterFieldDescriptors) {
-              if (std::get<FieldDescriptor::kSizeString>(dim) == p.name) {
-                if (!p.is_integer()) {
-                  std::cout << "[ERROR]: Field \"" << fd.name << "\" on type \""
-                            << dtypename << "\" has dimension parameter: \""
-                            << std::get<FieldDescriptor::kSizeString>(dim)
-                            << "\", which is a non-integer type: " << p.type
-                            << std::endl;
-                  abort();
-                }
-                found = true;
-              }
-            }
-
-            if (!found) {
-              std::cout << "[ERROR]: Field \"" << fd.name << "\" on type \""
-                        << dtypename << "\" has dimension parameter: \""
-                        << std::get<FieldDescriptor::kSizeString>(dim)
-                        << "\", which is not a declared parameter."
-                        << std::endl;
-              abort();
-            }
+      dtype.fields.push_back(fd);
+      log << "\t\t" << fd << std::endl;
+      ResolveShape(dtype.fields.back(), symbols, dtypename);
+    }
+
+    // struct-of-arrays types become a single instance where each field gets
+    // an extra slowest-varying dimension, indexed by instance
+    if (dtype.instances && (dtype.layout == InstanceLayout::kStructOfArrays)) {
+      for (auto &fd : dtype.fields) {
+        if (fd.is_string()) {
+          Error("Field \"", fd.name, "\" on type \"", dtypename, "\" is a "
+                "string, which cannot be laid out as a struct of arrays as we "
+                "cannot currently handle arrays of strings.");
+        }
+        if (fd.data.size()) {
+          if (fd.data.size() != size_t(fd.get_size())) {
+            Error("Field \"", fd.name, "\" on type \"", dtypename, "\" only "
+                  "partially initializes its data, which is not supported for "
+                  "struct of arrays layouts.");
+          }
+          auto instance_data = fd.data;
+          for (int i = 1; i < dtype.instances; ++i) {
+            fd.data.insert(fd.data.end(), instance_data.begin(),
+                           instance_data.end());
           }
         }
+        fd.size.push_back(instances_dim);
+        fd.shape.push_back(dtype.instances);
+      }
+    }
+
+    // the type default applies to every array field without its own align,
+    // including the instance-indexed fields of struct of arrays types
+    for (auto &fd : dtype.fields) {
+      if (fd.is_array() && !fd.align) {
+        fd.align = dtype.align;
+      }
+    }
+
+    // both languages see the same field order, so their layouts still match
+    if (dtype.pack) {
+      PackFields(dtype);
+    }
+
+    // hot fields lead the type so that they share as few cache lines as
+    // possible
+    std::stable_partition(dtype.fields.begin(), dtype.fields.end(),
+                          [](FieldDescriptor const &fd) { return fd.is_hot(); });
+
+    // explicit padding members are named pad_<field> and pad_tail, which
+    // must not clash with a field, ignoring case as Fortran does
+    if (dtype.has_explicit_padding()) {
+      auto lower = [](std::string str) {
+        std::transform(str.begin(), str.end(), str.begin(),
+                       [](unsigned char c) { return std::tolower(c); });
+        return str;
+      };
+      std::set<std::string> padding_names = {"pad_tail"};
+      for (auto const &fd : dtype.fields) {
+        padding_names.insert("pad_" + lower(fd.name));
+      }
+      for (auto const &fd : dtype.fields) {
+        if (padding_names.count(lower(fd.name))) {
+          Error("Field \"", fd.name, "\" on type \"", dtypename,
+                "\" has the name of a padding member, which types with "
+                "over-aligned fields reserve.");
+        }
       }
     }
   }
 
-  GenerateFortranModule(outstub + ".f90", modname, ParameterFieldDescriptors,
-                        TypeFieldDescriptors, Uses);
-  GenerateCInterface(outstub + ".h", modname, ParameterFieldDescriptors,
-                     TypeFieldDescriptors, Uses);
+  if (layout_report) {
+    log << std::endl << "Layout report: " << std::endl;
+    for (auto const &dt : TypeFieldDescriptors) {
+      LayoutReport(log, dt.first, dt.second);
+    }
+    return;
+  }
+
+  auto written = GenerateFortranModule(
+      outstub, modname, ParameterFieldDescriptors, TypeFieldDescriptors, Uses,
+      split_modules, emit_threads);
+  auto c_written =
+      GenerateCInterface(outstub, modname, ParameterFieldDescriptors,
+                         TypeFieldDescriptors, Uses, emit_threads);
+  written.insert(written.end(), c_written.begin(), c_written.end());
+
+  log << std::endl;
+  for (auto const &f : written) {
+    log << (f.second ? "Wrote: " : "Unchanged: ") << f.first << std::endl;
+  }
+}
+
+// Marks a successful run for build systems, after all outputs are written
+void WriteStampAndDepfile() {
+  if (stamp.size()) {
+    // truncating the file updates its modification time, even when empty
+    std::ofstream stamp_file(stamp, std::ios::trunc);
+    if (!stamp_file) {
+      Error("Failed to write stamp file: ", stamp);
+    }
+  }
+  if (depfile.size()) {
+    WriteDepfile();
+  }
+}
+
+int main(int argc, char const *argv[]) {
+  ParseOpts(argc, argv);
+
+  if (print_module_name || print_outputs) {
+    try {
+      for (auto const &job : jobs) {
+        if (print_module_name) {
+          std::cout << toml::find<std::string>(ParseDescriptor(job.first),
+                                               "name")
+                    << std::endl;
+        }
+        if (print_outputs) {
+          for (auto const &f : GetOutputs(job.first, job.second)) {
+            std::cout << f << std::endl;
+          }
+        }
+      }
+    } catch (std::exception const &e) {
+      std::cout << e.what() << std::endl;
+      return 1;
+    }
+    return 0;
+  }
+
+  if (nthreads < 1) {
+    nthreads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  if (jobs.size() == 1) {
+    emit_threads = nthreads;
+    try {
+      ProcessDescriptor(jobs[0].first, jobs[0].second, std::cout);
+      if (!layout_report) {
+        WriteStampAndDepfile();
+      }
+    } catch (std::exception const &e) {
+      std::cout << e.what() << std::endl
+                << "[ERROR]: Failed to generate " << jobs[0].first << std::endl;
+      return 1;
+    }
+    return 0;
+  }
+
+  // batch mode: a pool of threads takes descriptors in order, the log of
+  // each descriptor is printed in one piece once it is done. A descriptor
+  // that fails is reported in its log and does not stop the others, so the
+  // body catches its own errors instead of letting ParallelFor stop.
+  int total_threads = nthreads;
+  nthreads = std::min(nthreads, int(jobs.size()));
+  emit_threads = std::max(1, total_threads / nthreads);
+
+  std::atomic<int> failed{0};
+  std::mutex log_mutex;
+  ParallelFor(jobs.size(), nthreads, [&](size_t job) {
+    std::stringstream log("");
+    try {
+      ProcessDescriptor(jobs[job].first, jobs[job].second, log);
+    } catch (std::exception const &e) {
+      log << e.what() << std::endl
+          << "[ERROR]: Failed to generate " << jobs[job].first << std::endl;
+      failed++;
+    }
+    std::lock_guard<std::mutex> lock(log_mutex);
+    std::cout << log.str() << std::endl;
+  });
+
+  if (failed) {
+    std::cout << "[ERROR]: " << failed << " of " << jobs.size()
+              << " descriptors failed to generate." << std::endl;
+    return 1;
+  }
+  if (!layout_report) {
+    try {
+      WriteStampAndDepfile();
+    } catch (std::exception const &e) {
+      std::cout << e.what() << std::endl;
+      return 1;
+    }
+  }
 }
@@ -0,0 +1,193 @@
+// Times the generated access paths of types of growing size and prints the
+// cost per call and the payload moved per call. Reads run on each of the
+// requested numbers of threads at once. Writes to the instance of a type
+// without a concurrency mode race, so they only run on one thread.
+
+#define FORTMODGEN_EXPOSE_GLOBAL_INSTANCE
+#include "accessor_bench.h"
+#include "accessor_bench_types.h"
+
+#include "fmt/core.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace FortMod;
+
+// the report goes to a duplicate of stdout, stdout itself is redirected to
+// /dev/null so that the print routines can be timed
+FILE *report = stdout;
+
+double min_time = 0.2;
+std::vector<int> thread_counts;
+
+// keeps results alive without the cost of a volatile access per call
+template <typename T> void DoNotOptimize(T const &value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// Calls op n times on every one of nthreads threads, started together, and
+// returns the mean wall time per call on one thread in ns
+template <typename Op> double TimeOp(Op const &op, long n, int nthreads) {
+  std::atomic<int> ready{0};
+  std::atomic<bool> go{false};
+  std::vector<double> seconds(nthreads);
+
+  auto worker = [&](int t) {
+    ready++;
+    while (!go) {
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < n; ++i) {
+      op(int(i));
+    }
+    seconds[t] = std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+  };
+
+  std::vector<std::thread> pool;
+  for (int t = 0; t < nthreads; ++t) {
+    pool.emplace_back(worker, t);
+  }
+  while (ready != nthreads) {
+  }
+  go = true;
+  for (auto &t : pool) {
+    t.join();
+  }
+
+  double total = 0;
+  for (auto s : seconds) {
+    total += s;
+  }
+  return 1E9 * total / (double(n) * nthreads);
+}
+
+// Grows the number of calls until one thread runs for min_time, then times
+// op on each thread count
+template <typename Op>
+void Bench(std::string const &tname, std::string const &opname, size_t bytes,
+           bool read_only, Op const &op) {
+  long n = 1;
+  while (true) {
+    double ns = TimeOp(op, n, 1);
+    if ((ns * n * 1E-9) >= min_time) {
+      break;
+    }
+    n = std::max(n * 2, long(n * (min_time / std::max(ns * n * 1E-9, 1E-9))));
+  }
+
+  for (int nthreads : thread_counts) {
+    if (!read_only && (nthreads > 1)) {
+      continue;
+    }
+    double ns = TimeOp(op, n, nthreads);
+    fmt::print(report, "{:<12} {:<22} {:>8} {:>12.1f} {:>10} {:>10.2f}\n",
+               tname, opname, nthreads, ns, bytes, bytes / ns);
+    std::fflush(report);
+  }
+}
+
+#define ACCESSOR_BENCH_TYPE(T)                                                 \
+  {                                                                            \
+    std::string tname = #T;                                                    \
+    size_t nelems = sizeof(T##_t::farr) / sizeof(double);                      \
+    T##_t inst = T##IF::copy();                                                \
+    std::vector<double> buf(nelems);                                           \
+                                                                               \
+    Bench(tname, "copy", sizeof(T##_t), true,                                  \
+          [](int) { DoNotOptimize(T##IF::copy()); });                          \
+    Bench(tname, "update", sizeof(T##_t), false,                               \
+          [&](int) { T##IF::update(inst); });                                  \
+    Bench(tname, "transaction set_fint", sizeof(int), false, [](int i) {       \
+      T##IF::transaction tx;                                                   \
+      tx.set_fint(i);                                                          \
+    });                                                                        \
+    Bench(tname, "cached get", sizeof(int), true, [](int) {                    \
+      thread_local T##IF::cached cache;                                        \
+      DoNotOptimize(cache.get().fint);                                         \
+    });                                                                        \
+    Bench(tname, "instance().fint", sizeof(int), true,                         \
+          [](int) { DoNotOptimize(T##IF::const_instance().fint); });           \
+    Bench(tname, "get_fint", sizeof(int), true,                                \
+          [](int) { DoNotOptimize(T##IF::get_fint()); });                      \
+    Bench(tname, "set_fint", sizeof(int), false,                               \
+          [](int i) { T##IF::set_fint(i); });                                  \
+    Bench(tname, "get_fdouble", sizeof(double), true,                          \
+          [](int) { DoNotOptimize(T##IF::get_fdouble()); });                   \
+    Bench(tname, "get_fstr", 32, true,                                         \
+          [](int) { DoNotOptimize(T##IF::get_fstr()); });                      \
+    Bench(tname, "set_fstr", 32, false, [](int) {                              \
+      T##IF::set_fstr("a string of exactly 32 chars....");                     \
+    });                                                                        \
+    Bench(tname, "get_farr_elem", sizeof(double), true, [nelems](int i) {      \
+      DoNotOptimize(T##IF::get_farr_elem(i % nelems));                         \
+    });                                                                        \
+    Bench(tname, "get_farr", nelems * sizeof(double), true, [nelems](int) {    \
+      thread_local std::vector<double> out(nelems);                            \
+      T##IF::get_farr(out.data());                                             \
+      DoNotOptimize(out.front());                                              \
+    });                                                                        \
+    Bench(tname, "set_farr", nelems * sizeof(double), false,                   \
+          [&](int) { T##IF::set_farr(buf.data()); });                          \
+    Bench(tname, "print_" #T, sizeof(T##_t), false,                            \
+          [](int) { print_##T(); });                                           \
+    Bench(tname, "cprint_" #T, sizeof(T##_t), false,                           \
+          [](int) { cprint_##T(); });                                          \
+  }
+
+std::vector<int> ParseList(std::string const &list) {
+  std::vector<int> values;
+  std::stringstream ss(list);
+  std::string value;
+  while (std::getline(ss, value, ',')) {
+    values.push_back(std::atoi(value.c_str()));
+  }
+  return values;
+}
+
+void Usage(char const *argv[]) {
+  std::cout << "[USAGE]: " << argv[0]
+            << " [--min-time <seconds>] [--threads N[,N...]]" << std::endl;
+}
+
+int main(int argc, char const *argv[]) {
+  for (int opt_it = 1; opt_it < argc; ++opt_it) {
+    std::string arg = argv[opt_it];
+    if ((arg == "--min-time") && ((opt_it + 1) < argc)) {
+      min_time = std::atof(argv[++opt_it]);
+    } else if ((arg == "--threads") && ((opt_it + 1) < argc)) {
+      thread_counts = ParseList(argv[++opt_it]);
+    } else {
+      Usage(argv);
+      return 1;
+    }
+  }
+  if (thread_counts.empty()) {
+    int hw = std::max(1u, std::thread::hardware_concurrency());
+    for (int n = 1; n < hw; n *= 2) {
+      thread_counts.push_back(n);
+    }
+    thread_counts.push_back(hw);
+  }
+
+  std::fflush(stdout);
+  report = fdopen(dup(STDOUT_FILENO), "w");
+  int devnull = open("/dev/null", O_WRONLY);
+  dup2(devnull, STDOUT_FILENO);
+
+  fmt::print(report, "{:<12} {:<22} {:>8} {:>12} {:>10} {:>10}\n", "type",
+             "operation", "threads", "ns/op", "bytes/op", "GB/s");
+
+  ACCESSOR_BENCH_TYPES(ACCESSOR_BENCH_TYPE)
+}
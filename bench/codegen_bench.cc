@@ -0,0 +1,300 @@
+// Synthesizes descriptors of growing size and reports how long fortmodgen
+// takes to generate them, its peak resident set size, and how long the
+// generated Fortran module and C++ header take to compile.
+
+#include "fmt/core.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+struct Scale {
+  int ntypes;
+  int nfields;
+  int nparams;
+  int ndata;
+};
+
+struct RunResult {
+  double seconds = 0;
+  // peak resident set size of the child in MiB
+  double maxrss_mib = 0;
+};
+
+void Usage(char const *argv[]) {
+  std::cout << "[USAGE]: " << argv[0]
+            << " <work directory> [--types N[,N...]] [--fields N] "
+               "[--params N] [--data N]\n"
+               "          [--split-modules] [--threads N] [--no-compile] "
+               "[--compile-max-types N]"
+            << std::endl;
+}
+
+// Parameters are small integers so that arrays stay small and the cost is
+// dominated by the number of types, fields and parameter lookups. Every
+// eighth field carries a data array of ndata elements.
+std::string SynthesizeDescriptor(Scale const &s) {
+  std::stringstream ss("");
+  ss << "[module]\n\nname = \"bench" << s.ntypes << "\"\n\nparameters = [\n";
+  for (int p = 0; p < s.nparams; ++p) {
+    ss << fmt::format("  {{ name = \"p{}\", type = \"integer\", value = {} }},\n",
+                      p, 1 + (p % 8));
+  }
+  ss << "]\n\nderivedtypes = [";
+  for (int t = 0; t < s.ntypes; ++t) {
+    ss << ((t % 8) ? " " : "\n  ") << fmt::format("\"t{}\",", t);
+  }
+  ss << " ]\n";
+
+  for (int t = 0; t < s.ntypes; ++t) {
+    ss << fmt::format("\n[module.t{}]\ncomment = \"synthetic type {}\"\n"
+                      "fields = [\n",
+                      t, t);
+    for (int f = 0; f < s.nfields; ++f) {
+      int p = ((t * s.nfields) + f) % s.nparams;
+      int p2 = (p + 1) % s.nparams;
+      switch (f % 8) {
+      case 0: {
+        ss << fmt::format("  {{ name = \"f{}\", type = \"integer\", data = {}, "
+                          "attributes = [\"configurable\"] }},\n",
+                          f, t);
+        break;
+      }
+      case 1: {
+        ss << fmt::format("  {{ name = \"f{}\", type = \"float\" }},\n", f);
+        break;
+      }
+      case 2: {
+        ss << fmt::format(
+            "  {{ name = \"f{}\", type = \"double\", size = [\"p{}\"] }},\n", f,
+            p);
+        break;
+      }
+      case 3: {
+        ss << fmt::format("  {{ name = \"f{}\", type = \"bool\" }},\n", f);
+        break;
+      }
+      case 4: {
+        ss << fmt::format("  {{ name = \"f{}\", type = \"integer\", "
+                          "size = [\"p{}\", 3] }},\n",
+                          f, p);
+        break;
+      }
+      case 5: {
+        ss << fmt::format(
+            "  {{ name = \"f{}\", type = \"string\", size = 16 }},\n", f);
+        break;
+      }
+      case 6: {
+        ss << fmt::format("  {{ name = \"f{}\", type = \"double\", size = {}, "
+                          "data = [",
+                          f, s.ndata);
+        for (int d = 0; d < s.ndata; ++d) {
+          ss << fmt::format("{}{}", d ? ", " : "", 0.5 * d);
+        }
+        ss << "] },\n";
+        break;
+      }
+      case 7: {
+        ss << fmt::format("  {{ name = \"f{}\", type = \"float\", "
+                          "size = [\"p{}\", \"p{}\"] }},\n",
+                          f, p, p2);
+        break;
+      }
+      }
+    }
+    ss << "]\n";
+  }
+  return ss.str();
+}
+
+// Runs args in workdir with its output discarded
+RunResult Run(std::vector<std::string> const &args, std::string const &workdir) {
+  auto start = std::chrono::steady_clock::now();
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    std::cout << "[ERROR]: fork failed." << std::endl;
+    abort();
+  }
+  if (pid == 0) {
+    if (chdir(workdir.c_str())) {
+      _exit(127);
+    }
+    int devnull = open("/dev/null", O_WRONLY);
+    dup2(devnull, STDOUT_FILENO);
+    std::vector<char *> argv;
+    for (auto const &a : args) {
+      argv.push_back(const_cast<char *>(a.c_str()));
+    }
+    argv.push_back(nullptr);
+    execvp(argv[0], argv.data());
+    _exit(127);
+  }
+
+  int status = 0;
+  struct rusage usage;
+  wait4(pid, &status, 0, &usage);
+
+  RunResult result;
+  result.seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+#ifdef __APPLE__
+  result.maxrss_mib = usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+  result.maxrss_mib = usage.ru_maxrss / 1024.0;
+#endif
+
+  if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+    std::cout << "[ERROR]: Command failed: " << args.front();
+    for (size_t i = 1; i < args.size(); ++i) {
+      std::cout << " " << args[i];
+    }
+    std::cout << std::endl;
+    exit(1);
+  }
+  return result;
+}
+
+double FileSizeMiB(std::string const &fname) {
+  struct stat st;
+  return stat(fname.c_str(), &st) ? 0 : st.st_size / (1024.0 * 1024.0);
+}
+
+std::vector<int> ParseList(std::string const &list) {
+  std::vector<int> values;
+  std::stringstream ss(list);
+  std::string value;
+  while (std::getline(ss, value, ',')) {
+    values.push_back(std::atoi(value.c_str()));
+  }
+  return values;
+}
+
+int main(int argc, char const *argv[]) {
+  if (argc < 2) {
+    Usage(argv);
+    return 1;
+  }
+  std::string workdir = argv[1];
+
+  std::vector<int> ntypes = {10, 100, 1000};
+  Scale base{0, 16, 64, 256};
+  bool split_modules = false;
+  // passed on as fortmodgen -j, 0 leaves the default of one per core
+  int threads = 0;
+  bool compile = true;
+  // compiling the Fortran module grows to minutes beyond a few hundred types
+  int compile_max_types = 100;
+  for (int opt_it = 2; opt_it < argc; ++opt_it) {
+    std::string arg = argv[opt_it];
+    if (arg == "--split-modules") {
+      split_modules = true;
+    } else if (arg == "--no-compile") {
+      compile = false;
+    } else if ((opt_it + 1) < argc) {
+      if (arg == "--types") {
+        ntypes = ParseList(argv[++opt_it]);
+      } else if (arg == "--fields") {
+        base.nfields = std::atoi(argv[++opt_it]);
+      } else if (arg == "--params") {
+        base.nparams = std::atoi(argv[++opt_it]);
+      } else if (arg == "--data") {
+        base.ndata = std::atoi(argv[++opt_it]);
+      } else if (arg == "--threads") {
+        threads = std::atoi(argv[++opt_it]);
+      } else if (arg == "--compile-max-types") {
+        compile_max_types = std::atoi(argv[++opt_it]);
+      } else {
+        Usage(argv);
+        return 1;
+      }
+    } else {
+      Usage(argv);
+      return 1;
+    }
+  }
+  if (ntypes.empty() || (base.nfields < 1) || (base.nparams < 1)) {
+    Usage(argv);
+    return 1;
+  }
+  mkdir(workdir.c_str(), 0755);
+
+  fmt::print("{:>6} {:>6} {:>6} {:>6} | {:>9} {:>9} {:>9} {:>9} | {:>9} "
+             "{:>9}\n",
+             "types", "fields", "params", "data", "gen [s]", "RSS [MiB]",
+             "f90 [MiB]", "h [MiB]", "f90c [s]", "c++c [s]");
+
+  for (int n : ntypes) {
+    Scale s = base;
+    s.ntypes = n;
+    std::string stub = fmt::format("bench{}", n);
+
+    std::ofstream(workdir + "/" + stub + ".toml") << SynthesizeDescriptor(s);
+
+    std::vector<std::string> gen = {FORTMODGEN_EXE, "-i", stub + ".toml", "-o",
+                                    stub};
+    if (split_modules) {
+      gen.push_back("--split-modules");
+    }
+    if (threads > 0) {
+      gen.push_back("-j");
+      gen.push_back(std::to_string(threads));
+    }
+    auto generation = Run(gen, workdir);
+
+    double header_size = 0;
+    for (auto part :
+         {".h", "_structs.h", "_c.h", "_strings.h", "_cpp.h", "_print.h"}) {
+      header_size += FileSizeMiB(workdir + "/" + stub + part);
+    }
+
+    std::string fortran_time = "-", cpp_time = "-";
+    if (compile && (n <= compile_max_types)) {
+      // split modules are compiled one after the other, this measures the
+      // total work rather than the parallel build time
+      std::vector<std::string> fortran_sources = {stub + ".f90"};
+      if (split_modules) {
+        fortran_sources = {stub + "_common.f90"};
+        for (int t = 0; t < n; ++t) {
+          fortran_sources.push_back(fmt::format("{}_t{}.f90", stub, t));
+        }
+        fortran_sources.push_back(stub + ".f90");
+      }
+      double fortran_seconds = 0;
+      for (auto const &src : fortran_sources) {
+        fortran_seconds +=
+            Run({FORTMODGEN_BENCH_FC, "-O2", "-c", src, "-o", src + ".o"},
+                workdir)
+                .seconds;
+      }
+      fortran_time = fmt::format("{:.3f}", fortran_seconds);
+
+      std::ofstream(workdir + "/" + stub + "_tu.cc")
+          << "#include \"" << stub << ".h\"\n";
+      cpp_time = fmt::format(
+          "{:.3f}", Run({FORTMODGEN_BENCH_CXX, "-std=c++17", "-O2", "-c",
+                         stub + "_tu.cc", "-o", stub + "_tu.o"},
+                        workdir)
+                        .seconds);
+    }
+
+    fmt::print("{:>6} {:>6} {:>6} {:>6} | {:>9.3f} {:>9.1f} {:>9.2f} {:>9.2f} | "
+               "{:>9} {:>9}\n",
+               s.ntypes, s.nfields, s.nparams, s.ndata, generation.seconds,
+               generation.maxrss_mib,
+               FileSizeMiB(workdir + "/" + stub + ".f90"), header_size,
+               fortran_time, cpp_time);
+    std::fflush(stdout);
+  }
+}
@@ -1,6 +1,202 @@
+# The fortmodgen executable when it can be run at configure time, i.e. when
+# it comes from an installed FortModGen package rather than this build
+function(FortModGenExecutable OUTPUT_VARIABLE)
+  set(EXECUTABLE)
+  if(TARGET fortmodgen)
+    get_target_property(IMPORTED fortmodgen IMPORTED)
+    if(IMPORTED)
+      get_target_property(EXECUTABLE fortmodgen LOCATION)
+    endif()
+  endif()
+  set(${OUTPUT_VARIABLE} ${EXECUTABLE} PARENT_SCOPE)
+endfunction(FortModGenExecutable)
+
+# The files generated for an output stub, the header is split into parts
+# that can be included on their own. Passing the type names of the descriptor
+# adds the Fortran sources of split module output.
+function(FortModGenOutputs STUB OUTPUT_VARIABLE)
+  set(FILES
+    ${STUB}.f90 ${STUB}.h ${STUB}_structs.h ${STUB}_c.h ${STUB}_strings.h
+    ${STUB}_cpp.h ${STUB}_print.h)
+  if(ARGN)
+    list(APPEND FILES ${STUB}_common.f90)
+    foreach(TYPE ${ARGN})
+      list(APPEND FILES ${STUB}_${TYPE}.f90)
+    endforeach()
+  endif()
+  set(${OUTPUT_VARIABLE} ${FILES} PARENT_SCOPE)
+endfunction(FortModGenOutputs)
+
+# Whether any type of a descriptor uses shared memory storage, which needs the
+# C support file <stub>_shm.c and the rt library
+function(FortModGenUsesSharedMemory DESCRIPTOR OUTPUT_VARIABLE)
+  file(READ ${DESCRIPTOR} CONTENT)
+  set(SHM OFF)
+  if(CONTENT MATCHES "(^|\n)[ \t]*storage[ \t]*=[ \t]*[\"']shm[\"']")
+    set(SHM ON)
+  endif()
+  set(${OUTPUT_VARIABLE} ${SHM} PARENT_SCOPE)
+endfunction(FortModGenUsesSharedMemory)
+
+# Whether any type of a descriptor is seqlocked, which needs the C support
+# file <stub>_seqlock.c
+function(FortModGenUsesSeqLock DESCRIPTOR OUTPUT_VARIABLE)
+  file(READ ${DESCRIPTOR} CONTENT)
+  set(SEQLOCK OFF)
+  if(CONTENT MATCHES "(^|\n)[ \t]*concurrency[ \t]*=[ \t]*[\"']seqlock[\"']")
+    set(SEQLOCK ON)
+  endif()
+  set(${OUTPUT_VARIABLE} ${SEQLOCK} PARENT_SCOPE)
+endfunction(FortModGenUsesSeqLock)
+
+# The derivedtypes list of a descriptor. CMake is rerun when the descriptor
+# changes, as the split module sources depend on it.
+function(FortModGenTypeNames DESCRIPTOR OUTPUT_VARIABLE)
+  set_property(DIRECTORY APPEND PROPERTY CMAKE_CONFIGURE_DEPENDS ${DESCRIPTOR})
+  file(READ ${DESCRIPTOR} CONTENT)
+  if(NOT CONTENT MATCHES "(^|\n)[ \t]*derivedtypes[ \t]*=[ \t]*\\[([^]]*)\\]")
+    message(FATAL_ERROR "FortModGenTypeNames found no derivedtypes list in: \"${DESCRIPTOR}\".")
+  endif()
+  string(REGEX MATCHALL "\"[^\"]*\"" QUOTED "${CMAKE_MATCH_2}")
+  set(TYPES)
+  foreach(Q ${QUOTED})
+    string(REPLACE "\"" "" TYPE ${Q})
+    list(APPEND TYPES ${TYPE})
+  endforeach()
+  set(${OUTPUT_VARIABLE} ${TYPES} PARENT_SCOPE)
+endfunction(FortModGenTypeNames)
+
+# The files generated for a descriptor, as reported by fortmodgen
+# --print-outputs when it can be run, and from the descriptor's type names
+# otherwise
+function(FortModGenDescriptorOutputs DESCRIPTOR STUB SPLIT_MODULES OUTPUT_VARIABLE)
+  FortModGenExecutable(EXECUTABLE)
+  set(SPLIT_ARGS)
+  set(TYPES)
+  if(SPLIT_MODULES)
+    set(SPLIT_ARGS --split-modules)
+    FortModGenTypeNames(${DESCRIPTOR} TYPES)
+  endif()
+
+  if(EXECUTABLE)
+    execute_process(
+      COMMAND ${EXECUTABLE} --print-outputs -i ${DESCRIPTOR} -o ${STUB} ${SPLIT_ARGS}
+      OUTPUT_VARIABLE OV
+      RESULT_VARIABLE RV
+      OUTPUT_STRIP_TRAILING_WHITESPACE)
+    if(NOT RV EQUAL 0)
+      message(FATAL_ERROR "fortmodgen --print-outputs failed for: \"${DESCRIPTOR}\".")
+    endif()
+    string(REPLACE "\n" ";" FILES "${OV}")
+  else()
+    FortModGenOutputs(${STUB} FILES ${TYPES})
+    FortModGenUsesSharedMemory(${DESCRIPTOR} SHM)
+    if(SHM)
+      list(APPEND FILES ${STUB}_shm.c)
+    endif()
+    FortModGenUsesSeqLock(${DESCRIPTOR} SEQLOCK)
+    if(SEQLOCK)
+      list(APPEND FILES ${STUB}_seqlock.c)
+    endif()
+  endif()
+  set(${OUTPUT_VARIABLE} ${FILES} PARENT_SCOPE)
+endfunction(FortModGenDescriptorOutputs)
+
+# fortmodgen lists the descriptors it read in a depfile, which needs Ninja or
+# CMake 3.20 for the other generators. The descriptors are still passed as
+# DEPENDS so that older CMake versions keep working.
+function(FortModGenDepfileArgs NAME COMMAND_ARGS_VARIABLE DEPFILE_ARGS_VARIABLE)
+  set(${COMMAND_ARGS_VARIABLE} PARENT_SCOPE)
+  set(${DEPFILE_ARGS_VARIABLE} PARENT_SCOPE)
+  if((CMAKE_GENERATOR MATCHES "Ninja") OR (CMAKE_VERSION VERSION_GREATER_EQUAL 3.20))
+    set(DEPFILE ${CMAKE_CURRENT_BINARY_DIR}/${NAME}.d)
+    set(${COMMAND_ARGS_VARIABLE} --depfile ${DEPFILE} PARENT_SCOPE)
+    set(${DEPFILE_ARGS_VARIABLE} DEPFILE ${DEPFILE} PARENT_SCOPE)
+  endif()
+endfunction(FortModGenDepfileArgs)
+
+# gfortran has no directive that aligns a variable, so the generated Fortran
+# sources of a descriptor with align attributes are compiled with cache line
+# alignment for large objects on x86, which covers alignments of up to 64
+# bytes. Other compilers use the directive that the module carries.
+function(FortModGenAlignmentOptions DESCRIPTOR)
+  if(NOT CMAKE_Fortran_COMPILER_ID STREQUAL "GNU")
+    return()
+  endif()
+  if(NOT CMAKE_SYSTEM_PROCESSOR MATCHES "^(x86_64|AMD64|amd64|i[3-6]86)$")
+    return()
+  endif()
+  file(READ ${DESCRIPTOR} CONTENT)
+  if(NOT CONTENT MATCHES "(^|[\n{,])[ \t]*align[ \t]*=")
+    return()
+  endif()
+  foreach(FILE ${ARGN})
+    if(FILE MATCHES "\\.f90$")
+      set_property(SOURCE ${CMAKE_CURRENT_BINARY_DIR}/${FILE}
+        APPEND PROPERTY COMPILE_OPTIONS -malign-data=cacheline)
+    endif()
+  endforeach()
+endfunction(FortModGenAlignmentOptions)
+
+# Compiling generated sources pulls the generation step into the target
+# under Makefile generators, which do not write rules for byproducts. Only
+# these objects are then recompiled after an unchanged regeneration, the
+# module files they write are left untouched for their dependents.
+function(FortModGenObjectDepends STAMP)
+  if(CMAKE_GENERATOR MATCHES "Makefiles")
+    foreach(FILE ${ARGN})
+      if(FILE MATCHES "\\.(f90|c)$")
+        set_source_files_properties(${CMAKE_CURRENT_BINARY_DIR}/${FILE}
+          PROPERTIES OBJECT_DEPENDS ${CMAKE_CURRENT_BINARY_DIR}/${STAMP})
+      endif()
+    endforeach()
+  endif()
+endfunction(FortModGenObjectDepends)
+
+# Compiles the generated sources into TARGET, which also gets the directory
+# of the generated headers. Shared memory types need librt for shm_open on
+# glibc older than 2.34. They and seqlocked types need libatomic where the
+# compiler does not inline 8 byte atomics. Both are linked when they exist.
+function(FortModGenTargetSources TARGET)
+  set(SOURCES)
+  set(SHM OFF)
+  set(ATOMICS OFF)
+  foreach(FILE ${ARGN})
+    if(FILE MATCHES "\\.(f90|c)$")
+      list(APPEND SOURCES ${CMAKE_CURRENT_BINARY_DIR}/${FILE})
+    endif()
+    if(FILE MATCHES "_shm\\.c$")
+      set(SHM ON)
+    endif()
+    if(FILE MATCHES "_(shm|seqlock)\\.c$")
+      set(ATOMICS ON)
+    endif()
+  endforeach()
+  target_sources(${TARGET} PRIVATE ${SOURCES})
+  target_include_directories(${TARGET} PUBLIC ${CMAKE_CURRENT_BINARY_DIR})
+
+  if(SHM)
+    find_library(FORTMODGEN_RT_LIBRARY rt)
+    if(FORTMODGEN_RT_LIBRARY)
+      target_link_libraries(${TARGET} PUBLIC ${FORTMODGEN_RT_LIBRARY})
+    endif()
+  endif()
+  if(ATOMICS)
+    find_library(FORTMODGEN_ATOMIC_LIBRARY NAMES atomic libatomic.so.1)
+    if(FORTMODGEN_ATOMIC_LIBRARY)
+      target_link_libraries(${TARGET} PUBLIC ${FORTMODGEN_ATOMIC_LIBRARY})
+    endif()
+  endif()
+endfunction(FortModGenTargetSources)
+
+# With SPLIT_MODULES each derived type gets its own module in
+# <stub>_<type>.f90 next to <stub>_common.f90, all of which need to be
+# compiled along with <stub>.f90. Passing TARGET adds the generated sources
+# and their link dependencies to an existing library target.
 function(FortModGen)
 
-  set(oneValueArgs MOD_DESCRIPTOR_FILE MOD_OUTPUT_STUB)
+  set(options SPLIT_MODULES)
+  set(oneValueArgs MOD_DESCRIPTOR_FILE MOD_OUTPUT_STUB TARGET)
   cmake_parse_arguments(OPTS 
                       "${options}" 
                       "${oneValueArgs}"
@@ -16,15 +212,120 @@ function(FortModGen)
     message(FATAL_ERROR "FortModGen requires MOD_OUTPUT_STUB argument to be passed.")
   endif()
 
+  # fortmodgen only rewrites outputs whose content changed, so the stamp it
+  # writes records that the command ran while the generated sources keep
+  # their timestamps and do not trigger rebuilds of their dependents
+  set(SPLIT_ARGS)
+  if(OPTS_SPLIT_MODULES)
+    set(SPLIT_ARGS --split-modules)
+  endif()
+  FortModGenDescriptorOutputs(${OPTS_MOD_DESCRIPTOR_FILE} ${OPTS_MOD_OUTPUT_STUB}
+    "${OPTS_SPLIT_MODULES}" GENERATED_FILES)
+  FortModGenDepfileArgs(${OPTS_MOD_OUTPUT_STUB} DEPFILE_COMMAND_ARGS DEPFILE_ARGS)
+  if(POLICY CMP0116)
+    cmake_policy(PUSH)
+    cmake_policy(SET CMP0116 NEW)
+  endif()
   add_custom_command(
-    OUTPUT ${OPTS_MOD_OUTPUT_STUB}.f90 ${OPTS_MOD_OUTPUT_STUB}.h
+    OUTPUT ${OPTS_MOD_OUTPUT_STUB}.stamp
+    BYPRODUCTS ${GENERATED_FILES}
     WORKING_DIRECTORY ${CMAKE_CURRENT_BINARY_DIR}
     COMMAND $<TARGET_FILE:fortmodgen>
-    ARGS -i ${OPTS_MOD_DESCRIPTOR_FILE} -o ${OPTS_MOD_OUTPUT_STUB}
+    ARGS -i ${OPTS_MOD_DESCRIPTOR_FILE} -o ${OPTS_MOD_OUTPUT_STUB} ${SPLIT_ARGS}
+         --stamp ${CMAKE_CURRENT_BINARY_DIR}/${OPTS_MOD_OUTPUT_STUB}.stamp
+         ${DEPFILE_COMMAND_ARGS}
+    ${DEPFILE_ARGS}
     DEPENDS fortmodgen ${OPTS_MOD_DESCRIPTOR_FILE})
+  if(POLICY CMP0116)
+    cmake_policy(POP)
+  endif()
+
+  FortModGenObjectDepends(${OPTS_MOD_OUTPUT_STUB}.stamp ${GENERATED_FILES})
+  FortModGenAlignmentOptions(${OPTS_MOD_DESCRIPTOR_FILE} ${GENERATED_FILES})
+  if(DEFINED OPTS_TARGET)
+    FortModGenTargetSources(${OPTS_TARGET} ${GENERATED_FILES})
+  endif()
 
 endfunction(FortModGen)
 
+# Generates many modules with a single fortmodgen invocation that processes
+# the descriptors on a pool of threads. MOD_OUTPUT_STUBS pairs up with
+# MOD_DESCRIPTOR_FILES in order, paths must not contain whitespace.
+# SPLIT_MODULES applies to all of the descriptors, and TARGET gets the
+# sources of all of them as for FortModGen.
+function(FortModGenBatch)
+
+  set(options SPLIT_MODULES)
+  set(oneValueArgs NAME THREADS TARGET)
+  set(multiValueArgs MOD_DESCRIPTOR_FILES MOD_OUTPUT_STUBS)
+  cmake_parse_arguments(OPTS
+                      "${options}"
+                      "${oneValueArgs}"
+                      "${multiValueArgs}" ${ARGN})
+
+  if(NOT DEFINED OPTS_NAME)
+    message(FATAL_ERROR "FortModGenBatch requires NAME argument to be passed.")
+  endif()
+  list(LENGTH OPTS_MOD_DESCRIPTOR_FILES NDESCRIPTORS)
+  list(LENGTH OPTS_MOD_OUTPUT_STUBS NSTUBS)
+  if((NDESCRIPTORS EQUAL 0) OR (NOT NDESCRIPTORS EQUAL NSTUBS))
+    message(FATAL_ERROR "FortModGenBatch requires one MOD_OUTPUT_STUBS entry for each of its MOD_DESCRIPTOR_FILES.")
+  endif()
+
+  set(MANIFEST_CONTENT "")
+  set(GENERATED_FILES)
+  math(EXPR LAST "${NDESCRIPTORS} - 1")
+  foreach(i RANGE ${LAST})
+    list(GET OPTS_MOD_DESCRIPTOR_FILES ${i} DESCRIPTOR)
+    list(GET OPTS_MOD_OUTPUT_STUBS ${i} STUB)
+    if(NOT EXISTS ${DESCRIPTOR})
+      message(FATAL_ERROR "FortModGenBatch passed MOD_DESCRIPTOR_FILES entry: \"${DESCRIPTOR}\" to non-existant file.")
+    endif()
+    string(APPEND MANIFEST_CONTENT "${DESCRIPTOR} ${STUB}\n")
+    FortModGenDescriptorOutputs(${DESCRIPTOR} ${STUB} "${OPTS_SPLIT_MODULES}"
+      STUB_FILES)
+    FortModGenAlignmentOptions(${DESCRIPTOR} ${STUB_FILES})
+    list(APPEND GENERATED_FILES ${STUB_FILES})
+  endforeach()
+  FortModGenObjectDepends(${OPTS_NAME}.stamp ${GENERATED_FILES})
+
+  set(MANIFEST ${CMAKE_CURRENT_BINARY_DIR}/${OPTS_NAME}.fortmodgen_batch)
+  file(GENERATE OUTPUT ${MANIFEST} CONTENT "${MANIFEST_CONTENT}")
+
+  set(BATCH_ARGS)
+  if(DEFINED OPTS_THREADS)
+    set(BATCH_ARGS -j ${OPTS_THREADS})
+  endif()
+  if(OPTS_SPLIT_MODULES)
+    list(APPEND BATCH_ARGS --split-modules)
+  endif()
+
+  # outputs are only rewritten when they change, as for FortModGen
+  FortModGenDepfileArgs(${OPTS_NAME} DEPFILE_COMMAND_ARGS DEPFILE_ARGS)
+  if(POLICY CMP0116)
+    cmake_policy(PUSH)
+    cmake_policy(SET CMP0116 NEW)
+  endif()
+  add_custom_command(
+    OUTPUT ${OPTS_NAME}.stamp
+    BYPRODUCTS ${GENERATED_FILES}
+    WORKING_DIRECTORY ${CMAKE_CURRENT_BINARY_DIR}
+    COMMAND $<TARGET_FILE:fortmodgen>
+    ARGS --batch ${MANIFEST} ${BATCH_ARGS}
+         --stamp ${CMAKE_CURRENT_BINARY_DIR}/${OPTS_NAME}.stamp
+         ${DEPFILE_COMMAND_ARGS}
+    ${DEPFILE_ARGS}
+    DEPENDS fortmodgen ${MANIFEST} ${OPTS_MOD_DESCRIPTOR_FILES})
+  if(POLICY CMP0116)
+    cmake_policy(POP)
+  endif()
+
+  if(DEFINED OPTS_TARGET)
+    FortModGenTargetSources(${OPTS_TARGET} ${GENERATED_FILES})
+  endif()
+
+endfunction(FortModGenBatch)
+
 function(FortModName)
   set(oneValueArgs MOD_DESCRIPTOR_FILE OUTPUT_VARIABLE)
   cmake_parse_arguments(OPTS 
@@ -42,11 +343,28 @@ function(FortModName)
     message(FATAL_ERROR "FortModName requires OUTPUT_VARIABLE argument to be passed.")
   endif()
 
-  execute_process(COMMAND 
-    bash -c "( ( test -e ./module_name ) || (g++ -I ${toml11_SOURCE_DIR}/include ${CMAKE_CURRENT_FUNCTION_LIST_DIR}/module_name.cc -o module_name ) ) && ./module_name ${OPTS_MOD_DESCRIPTOR_FILE}"
-    OUTPUT_VARIABLE OV
-    WORKING_DIRECTORY ${CMAKE_CURRENT_BINARY_DIR} 
-    OUTPUT_STRIP_TRAILING_WHITESPACE)
+  # an installed fortmodgen reads the name with the full toml parser, inside
+  # the FortModGen build it does not exist yet at configure time and the name
+  # is read from the [module] table directly
+  FortModGenExecutable(EXECUTABLE)
+  if(EXECUTABLE)
+    execute_process(
+      COMMAND ${EXECUTABLE} --print-module-name -i ${OPTS_MOD_DESCRIPTOR_FILE}
+      OUTPUT_VARIABLE OV
+      RESULT_VARIABLE RV
+      OUTPUT_STRIP_TRAILING_WHITESPACE)
+    if(NOT RV EQUAL 0)
+      message(FATAL_ERROR "fortmodgen --print-module-name failed for: \"${OPTS_MOD_DESCRIPTOR_FILE}\".")
+    endif()
+  else()
+    file(READ ${OPTS_MOD_DESCRIPTOR_FILE} CONTENT)
+    string(REGEX REPLACE "^(.*\n)?[ \t]*\\[module\\][^\n]*" "" MODULE_TABLE "${CONTENT}")
+    string(REGEX REPLACE "\n[ \t]*\\[.*$" "" MODULE_TABLE "${MODULE_TABLE}")
+    if(NOT MODULE_TABLE MATCHES "(^|\n)[ \t]*name[ \t]*=[ \t]*[\"']([^\"']*)[\"']")
+      message(FATAL_ERROR "FortModName found no [module] name in: \"${OPTS_MOD_DESCRIPTOR_FILE}\".")
+    endif()
+    set(OV ${CMAKE_MATCH_2})
+  endif()
 
   set(${OPTS_OUTPUT_VARIABLE} ${OV} PARENT_SCOPE)
 endfunction(FortModName)
\ No newline at end of file
@@ -1,30 +1,34 @@
 #include "FortranModuleGenerator.h"
 #include "utils.h"
 
-#include "fmt/os.h"
+#include "fmt/format.h"
 
 #include <map>
+#include <sstream>
 
-std::map<FieldType, std::string> FortranFieldTypes = {
+std::map<FieldType, std::string> const FortranFieldTypes = {
     {FieldType::kInteger, "integer"},     {FieldType::kString, "character"},
     {FieldType::kCharacter, "character"}, {FieldType::kFloat, "real"},
     {FieldType::kDouble, "real"},         {FieldType::kBool, "logical"},
 };
 
-std::map<FieldType, std::string> FortranFieldKinds = {
+std::map<FieldType, std::string> const FortranFieldKinds = {
     {FieldType::kInteger, "C_INT"},    {FieldType::kString, "C_CHAR"},
     {FieldType::kCharacter, "C_CHAR"}, {FieldType::kFloat, "C_FLOAT"},
     {FieldType::kDouble, "C_DOUBLE"},  {FieldType::kBool, "C_BOOL"},
 };
 
-std::map<FieldType, std::string> FortranPrintFormatSpecifier = {
+std::map<FieldType, std::string> const FortranPrintFormatSpecifier = {
     {FieldType::kInteger, "I3X"},      {FieldType::kString, "999A"},
     {FieldType::kCharacter, "A"},      {FieldType::kFloat, "ES10.3E1X"},
     {FieldType::kDouble, "ES10.3E1X"}, {FieldType::kBool, "LX"},
 };
 
-void FortranFileHeader(fmt::ostream &os, std::string const &modname,
+void FortranFileHeader(OutputBuffer &os, std::string const &modname,
                        std::vector<std::string> const &Uses) {
+  os.print("! Generated by FortModGen, do not edit.\n"
+           "! Content hash (FNV-1a): {}\n",
+           kContentHashPlaceholder);
   os.print("module {}\n  use iso_c_binding\n", modname);
   for (auto const &u : Uses) {
     os.print("  use {}\n", u);
@@ -44,7 +48,34 @@ std::string FortranLiteralEtoD(FieldType const &ft, std::string str) {
   return str;
 }
 
-void FortranModuleParameters(fmt::ostream &os,
+// Designator of the instance that a generated procedure acts on. Instance
+// arrays are indexed by an extra leading inst argument, which is 0-based for
+// the procedures that are called from C.
+std::string FortranInstance(std::string const &dtypename,
+                            DerivedType const &dtype,
+                            std::string const &index = "inst+1") {
+  return dtype.is_instance_array() ? fmt::format("{}({})", dtypename, index)
+                                   : dtypename;
+}
+
+std::string FortranInstanceDummy(DerivedType const &dtype,
+                                 bool more_dummies = true) {
+  if (!dtype.is_instance_array()) {
+    return "";
+  }
+  return more_dummies ? "inst, " : "inst";
+}
+
+std::string FortranInstanceDecl(DerivedType const &dtype,
+                                bool c_callable = true) {
+  if (!dtype.is_instance_array()) {
+    return "";
+  }
+  return c_callable ? "      integer(kind=C_INT), value :: inst\n"
+                    : "      integer, intent(in) :: inst\n";
+}
+
+void FortranModuleParameters(OutputBuffer &os,
                              ParameterFields const &ParameterFieldDescriptors) {
   for (auto const &p : ParameterFieldDescriptors) {
     std::string comment = SanitizeComment(p.comment, "  !");
@@ -53,19 +84,19 @@ void FortranModuleParameters(fmt::ostream &os,
     }
     if (p.is_string()) {
       os.print("  {}(kind={},len=*), parameter :: {} = \"{}\"\n",
-               FortranFieldTypes[p.type], FortranFieldKinds[p.type], p.name,
+               FortranFieldTypes.at(p.type), FortranFieldKinds.at(p.type), p.name,
                p.value);
     } else {
 
       os.print("  {}(kind={}), parameter :: {} = {}\n",
-               FortranFieldTypes[p.type], FortranFieldKinds[p.type], p.name,
+               FortranFieldTypes.at(p.type), FortranFieldKinds.at(p.type), p.name,
                FortranLiteralEtoD(p.type, p.value));
     }
   }
   os.print("\n");
 }
 
-void FortranDerivedTypeHeader(fmt::ostream &os, std::string const &dtypename,
+void FortranDerivedTypeHeader(OutputBuffer &os, std::string const &dtypename,
                               std::string comment) {
 
   comment = SanitizeComment(comment, "  !");
@@ -75,28 +106,111 @@ void FortranDerivedTypeHeader(fmt::ostream &os, std::string const &dtypename,
   os.print("  type, bind(C) :: t_{}\n", dtypename);
 }
 
-void FortranDerivedTypeField(fmt::ostream &os, FieldDescriptor const &fd,
-                             ParameterFields const &parameters) {
+std::string FortranDimensionList(FieldDescriptor const &fd) {
+  std::string dims = "";
+  for (size_t i = 0; i < fd.size.size(); ++i) {
+    int dim_size = fd.get_dim_size(i);
+    if (fd.is_string()) { // keep an extra character around that the interface
+                          // functions don't use and put a C_NULL_CHAR in it.
+      dim_size++;
+    }
+    dims += fmt::format("{}{}", dim_size,
+                        ((i + 1 == fd.size.size()) ? "" : ", "));
+  }
+  return dims;
+}
+
+std::string DataElementToString(FieldType ft,
+                                FieldDescriptor::data_element_type const &d);
+
+// Default initialization for a field of an array of structs, where data
+// statements cannot reach the components of every instance
+std::string FortranFieldDefaultInitialization(FieldDescriptor const &fd) {
+  if (fd.is_string()) {
+    return " = C_NULL_CHAR";
+  }
+  if (!fd.data.size()) {
+    return "";
+  }
+  if (!fd.is_array()) {
+    return fmt::format(" = {}", DataElementToString(fd.type, fd.data.front()));
+  }
+
+  std::string init = fmt::format(" = {}[{}(kind={}) :: ",
+                                 (fd.size.size() > 1) ? "reshape(" : "",
+                                 FortranFieldTypes.at(fd.type),
+                                 FortranFieldKinds.at(fd.type));
+  std::string line = "";
+  int size = fd.get_size();
+  for (int i = 0; i < size; ++i) {
+    // unset trailing elements are zeroed, as they would be by a data statement
+    auto data_el = (size_t(i) < fd.data.size())
+                       ? DataElementToString(fd.type, fd.data[i])
+                       : ((fd.type == FieldType::kBool) ? ".false." : "0");
+    if ((line.length() + data_el.length() + 2) > 66) {
+      init += line + "&\n&      ";
+      line = "";
+    }
+    line += data_el + (((i + 1) == size) ? "]" : ", ");
+  }
+  init += line;
+  if (fd.size.size() > 1) {
+    init += fmt::format(", [{}])", FortranDimensionList(fd));
+  }
+  return init;
+}
+
+void FortranDerivedTypeField(OutputBuffer &os, FieldDescriptor const &fd,
+                             DerivedType const &dtype) {
 
   std::string comment = SanitizeComment(fd.comment, "    !");
   if (comment.length()) {
     os.print("    !{}\n", comment);
   }
-  os.print("    {}(kind={})", FortranFieldTypes[fd.type],
-           FortranFieldKinds[fd.type]);
+  os.print("    {}(kind={})", FortranFieldTypes.at(fd.type),
+           FortranFieldKinds.at(fd.type));
   if (fd.is_array()) {
-    os.print(", dimension(");
-    for (int i = 0; i < fd.size.size(); ++i) {
-      int dim_size = fd.get_dim_size(i, parameters);
-      if (fd.is_string()) { // keep an extra character around that the interface
-                            // functions don't use and put a C_NULL_CHAR in it.
-        dim_size++;
-      }
-      os.print("{}{}", dim_size, ((i + 1 == fd.size.size()) ? "" : ", "));
+    os.print(", dimension({})", FortranDimensionList(fd));
+  }
+  os.print(" :: {}{}\n", fd.name,
+           dtype.is_instance_array()
+               ? FortranFieldDefaultInitialization(fd)
+               : "");
+}
+
+// Emits the fields of a type. Types with over-aligned fields get every gap
+// spelled out as a character array, so that neither compiler inserts padding
+// of its own and the bind(C) type matches the C struct
+void FortranDerivedTypeFields(OutputBuffer &os, DerivedType const &dtype) {
+  auto dtl = GetLayout(dtype);
+  bool explicit_padding = dtype.has_explicit_padding();
+  for (size_t i = 0; i < dtype.fields.size(); ++i) {
+    if (explicit_padding && dtl.fields[i].padding) {
+      os.print("    character(kind=C_CHAR), dimension({}) :: pad_{}\n",
+               dtl.fields[i].padding, dtype.fields[i].name);
     }
-    os.print(")");
+    FortranDerivedTypeField(os, dtype.fields[i], dtype);
+  }
+  if (explicit_padding && dtl.tail_padding) {
+    os.print("    character(kind=C_CHAR), dimension({}) :: pad_tail\n",
+             dtl.tail_padding);
   }
-  os.print(" :: {}\n", fd.name);
+}
+
+// The C header checks every field offset against the same computed layout
+void FortranDerivedTypeLayoutCheck(OutputBuffer &os,
+                                   std::string const &dtypename,
+                                   DerivedType const &dtype) {
+  os.print(R"(  ! fails to compile with a division by zero if t_{0} does not have
+  ! the size that the C interface expects
+  integer, parameter, private :: {0}_layout_check = &
+&     1/merge(1, 0, c_sizeof({1}) == {2})
+
+)",
+           dtypename,
+           FortranInstance(dtypename + (dtype.is_shared() ? "_local" : ""),
+                           dtype, "1"),
+           GetLayout(dtype).size);
 }
 
 std::string DataElementToString(FieldType ft,
@@ -131,23 +245,19 @@ std::string DataElementToString(FieldType ft,
     if (d.index() == 0) { // int
       return std::get<0>(d) ? ".true." : ".false.";
     } else {
-      std::cout << "[ERROR]: Invalid data type variant index: " << d.index()
-                << ", expected 0 == int for Field of type bool." << std::endl;
-      abort();
+      Error("Invalid data type variant index: ", d.index(), ", expected 0 == "
+            "int for Field of type bool.");
     }
   }
-  std::cout << "[ERROR]: Cannot transcribe FieldType: " << ft << " to data."
-            << std::endl;
-  abort();
+  Error("Cannot transcribe FieldType: ", ft, " to data.");
 }
 
-void FortranDerivedTypeFieldData(fmt::ostream &os, std::string const &dtypename,
-                                 FieldDescriptor const &fd,
-                                 ParameterFields const &parameters) {
+void FortranDerivedTypeFieldData(OutputBuffer &os, std::string const &dtypename,
+                                 FieldDescriptor const &fd) {
 
   if (fd.is_string()) { // put a C_NULL_CHAR at the end of any string array
     os.print("  data {0}%{1}({2}:{2})/C_NULL_CHAR/\n", dtypename, fd.name,
-             fd.get_size(parameters) + 1);
+             fd.get_size() + 1);
     return;
   }
 
@@ -163,7 +273,7 @@ void FortranDerivedTypeFieldData(fmt::ostream &os, std::string const &dtypename,
 
   os.print(data_fmt, dtypename, fd.name);
   if (fd.is_array()) {
-    int ents = std::min(int(fd.data.size()), fd.get_size(parameters));
+    int ents = std::min(int(fd.data.size()), fd.get_size());
     for (int i = 0; i < ents; ++i) {
 
       auto data_el = DataElementToString(fd.type, fd.data[i]);
@@ -182,20 +292,102 @@ void FortranDerivedTypeFieldData(fmt::ostream &os, std::string const &dtypename,
   }
 }
 
-void FortranStringAccessor(fmt::ostream &os, std::string const &dtypename,
-                           FieldDescriptor const &fd,
-                           ParameterFields const &parameters) {
+// First statement of a procedure that modifies the instance. Readers of a
+// shared memory segment map it read-only, so these stop with an error
+// instead of faulting.
+std::string FortranWriteCheck(std::string const &dtypename,
+                              DerivedType const &dtype,
+                              std::string const &procname) {
+  if (!dtype.is_shared()) {
+    return "";
+  }
+  return fmt::format("      call check_writable_{}('{}')\n\n", dtypename,
+                     procname);
+}
+
+// Procedures of seqlocked types access the instance under the lock helpers
+// of the module's C support file, and declare the counter value they hold.
+std::string FortranSeqLockDecl(DerivedType const &dtype) {
+  if (!dtype.is_seqlocked()) {
+    return "";
+  }
+  return "      integer(kind=C_INT64_T) :: fmg_seq\n";
+}
+
+// Repeats the statements of body, which read the instance, until no writer
+// was active meanwhile
+std::string FortranSeqLockRead(std::string const &dtypename,
+                               DerivedType const &dtype,
+                               std::string const &body) {
+  if (!dtype.is_seqlocked()) {
+    return body;
+  }
+  std::string indented = "";
+  std::istringstream lines(body);
+  for (std::string line; std::getline(lines, line);) {
+    indented += (line.empty() ? "" : "  ") + line + "\n";
+  }
+  return fmt::format(R"(      do
+        fmg_seq = fmg_seqlock_read_begin({0}_seqlock)
+{1}        if (fmg_seqlock_read_retry({0}_seqlock, fmg_seq).eq.0) exit
+      end do
+)",
+                     dtypename, indented);
+}
+
+// Statements that take and release the write side of the lock around the
+// modification of the instance, including the bump of its counter
+std::string FortranSeqLockWriteBegin(std::string const &dtypename,
+                                     DerivedType const &dtype,
+                                     std::string const &indent = "      ") {
+  if (!dtype.is_seqlocked()) {
+    return "";
+  }
+  return fmt::format("{}fmg_seq = fmg_seqlock_write_begin({}_seqlock)\n",
+                     indent, dtypename);
+}
+
+std::string FortranSeqLockWriteEnd(std::string const &dtypename,
+                                   DerivedType const &dtype,
+                                   std::string const &indent = "      ") {
+  if (!dtype.is_seqlocked()) {
+    return "";
+  }
+  return fmt::format("{}call fmg_seqlock_write_end({}_seqlock, fmg_seq)\n",
+                     indent, dtypename);
+}
+
+void FortranStringAccessor(OutputBuffer &os, std::string const &dtypename,
+                           DerivedType const &dtype,
+                           FieldDescriptor const &fd) {
+
+  // seqlocked types copy the characters under the lock and trim the copy
+  auto instance = FortranInstance(dtypename, dtype, "inst");
+  std::string str_decl = "", str_read = "";
+  if (dtype.is_seqlocked()) {
+    str_decl = FortranSeqLockDecl(dtype) +
+               fmt::format("      character(kind=C_CHAR), dimension({}) :: "
+                           "fmg_str\n",
+                           FortranDimensionList(fd));
+    str_read = FortranSeqLockRead(
+                   dtypename, dtype,
+                   fmt::format("      fmg_str = {}%{}\n", instance, fd.name)) +
+               "\n";
+  }
 
   os.print(R"-(
-    function get_{0}_{1}() result(out_str)
+    function get_{0}_{1}({5}) result(out_str)
       use iso_c_binding
       implicit none
 
-      character(len=:), allocatable :: out_str
-      integer :: loop_end = 0, i
+{6}      character(len=:), allocatable :: out_str
+{8}      integer :: loop_end, i
 
+{9}      ! no initializer in the declaration, which would imply SAVE and share
+      ! the variable between calls and threads
+      loop_end = 0
       do i = {2}, 1, -1 
-          if (.not.(({0}%{1}(i).eq.' ').or.({0}%{1}(i).eq.C_NULL_CHAR))) then
+          if (.not.(({10}(i).eq.' ').or.({10}(i).eq.C_NULL_CHAR))) then
             loop_end = i
             exit
           end if
@@ -206,20 +398,22 @@ void FortranStringAccessor(fmt::ostream &os, std::string const &dtypename,
       end if
 
       do i = 1, loop_end
-          out_str(i:i) = {0}%{1}(i)
+          out_str(i:i) = {10}(i)
       end do
 
     end function get_{0}_{1}
 
-    subroutine set_{0}_{1}(in_str)
+    subroutine set_{0}_{1}({4}in_str)
       use iso_c_binding
       implicit none
 
-      character(kind=C_CHAR,len=*), intent(in) :: in_str
-      integer :: loop_end = 0, i
+{6}      character(kind=C_CHAR,len=*), intent(in) :: in_str
+{11}      integer :: loop_end, i
+
+{7}      loop_end = 0
 
-      ! blank out the string (but don't flatten the secret C_NULL_CHAR backstop)
-      {0}%{1}(1:{2}) = ' '
+{12}      ! blank out the string (but don't flatten the secret C_NULL_CHAR backstop)
+      {3}%{1}(1:{2}) = ' '
 
       do i = len(in_str), 1, -1
         if (.not.((in_str(i:i).eq.' ').or.(in_str(i:i).eq.C_NULL_CHAR))) then
@@ -232,25 +426,106 @@ void FortranStringAccessor(fmt::ostream &os, std::string const &dtypename,
 
       ! copy the relevant characters
       do i = 1, loop_end
-          {0}%{1}(i) = in_str(i:i)
+          {3}%{1}(i) = in_str(i:i)
       end do
 
       ! put a C_NULL_CHAR after the last copied character
-      {0}%{1}(loop_end+1) = C_NULL_CHAR
-    end subroutine set_{0}_{1}
+      {3}%{1}(loop_end+1) = C_NULL_CHAR
+      {0}_version = {0}_version + 1
+{13}    end subroutine set_{0}_{1}
 )-",
-           dtypename, fd.name, fd.get_size(parameters));
+           dtypename, fd.name, fd.get_size(), instance,
+           FortranInstanceDummy(dtype), FortranInstanceDummy(dtype, false),
+           FortranInstanceDecl(dtype, false),
+           FortranWriteCheck(dtypename, dtype,
+                             fmt::format("set_{}_{}", dtypename, fd.name)),
+           str_decl, str_read,
+           dtype.is_seqlocked() ? "fmg_str" : instance + "%" + fd.name,
+           FortranSeqLockDecl(dtype),
+           FortranSeqLockWriteBegin(dtypename, dtype),
+           FortranSeqLockWriteEnd(dtypename, dtype));
 }
 
-void FortranDerivedTypeFooter(fmt::ostream &os, std::string const &dtypename) {
-  os.print("\n  end type t_{0}\n\n  type (t_{0}), save, bind(C) :: {0}\n\n",
-           dtypename);
+// Fortran has no standard way to over-align a variable. Compilers that know
+// the directive align the global as its C struct is, gfortran ignores it and
+// relies on the build, see FortModGen.cmake. check_<type>_layout() reports
+// an instance that ends up misaligned.
+std::string FortranAlignDirective(std::string const &varname,
+                                  DerivedType const &dtype) {
+  if (!dtype.has_explicit_padding()) {
+    return "";
+  }
+  return fmt::format("  !DIR$ ATTRIBUTES ALIGN: {} :: {}\n",
+                     GetLayout(dtype).alignment, varname);
+}
+
+void FortranDerivedTypeFooter(OutputBuffer &os, std::string const &dtypename,
+                              DerivedType const &dtype) {
+  if (dtype.is_shared()) {
+    // the instance and its counter point into the shared memory segment while
+    // attached, and at process-local copies otherwise
+    os.print(R"(
+  end type t_{0}
+
+  type (t_{0}), save, target :: {0}_local{1}
+{3}  type (t_{0}), pointer :: {0}{2} => {0}_local
+  integer(kind=C_INT64_T), save, target :: {0}_version_local = 0
+  integer(kind=C_INT64_T), pointer :: {0}_version => {0}_version_local
+  type (c_ptr), save :: {0}_segment = C_NULL_PTR
+  logical, save :: {0}_readonly = .false.
+
+)",
+             dtypename,
+             dtype.is_instance_array() ? fmt::format("({})", dtype.instances)
+                                       : "",
+             dtype.is_instance_array() ? "(:)" : "",
+             FortranAlignDirective(dtypename + "_local", dtype));
+    return;
+  }
+  os.print(
+      "\n  end type t_{0}\n\n  type (t_{0}), save, target, bind(C) :: {0}{1}\n",
+      dtypename,
+      dtype.is_instance_array() ? fmt::format("({})", dtype.instances) : "");
+  os.print(FortranAlignDirective(dtypename, dtype));
+  // bumped by every generated procedure that modifies the instance
+  os.print("  integer(kind=C_INT64_T), save, {1}bind(C) :: {0}_version = 0\n",
+           dtypename, dtype.threadprivate ? "target, " : "");
+  if (dtype.is_seqlocked()) { // odd while a writer holds the lock
+    os.print("  integer(kind=C_INT64_T), save, bind(C) :: {0}_seqlock = 0\n",
+             dtypename);
+  }
+  if (dtype.threadprivate) { // each OpenMP (or native) thread gets its own
+    // the directive is a comment without OpenMP, which would silently leave
+    // a single instance shared by all threads, so the module refuses to
+    // compile instead: only the !$ sentinel line declares the parameter
+    os.print(R"(  !$omp threadprivate({0}, {0}_version)
+  !$ integer, parameter, private :: {0}_openmp = 1
+  ! fails to compile without OpenMP, which threadprivate types require
+  integer, parameter, private :: {0}_requires_openmp = {0}_openmp
+)",
+             dtypename);
+  }
+  os.print("\n");
+}
+
+// Standalone types holding only the hot or only the cold fields of a type
+void FortranDerivedTypeHotColdParts(OutputBuffer &os,
+                                    std::string const &dtypename,
+                                    DerivedType const &dtype) {
+  for (auto const &part : {"hot", "cold"}) {
+    auto part_type = dtype.get_hot_cold_part(std::string(part) == "hot");
+    if (!part_type.fields.size()) {
+      continue;
+    }
+    os.print("  type, bind(C) :: t_{}_{}\n", dtypename, part);
+    FortranDerivedTypeFields(os, part_type);
+    os.print("  end type t_{}_{}\n\n", dtypename, part);
+  }
 }
 
 void FortranPrintArrayRecursiveHelper(
-    fmt::ostream &os, std::string const &dtypename,
-    ParameterFields const &parameters,
-    decltype(DerivedTypes::mapped_type::fields)::value_type const &fd, int d,
+    OutputBuffer &os, std::string const &dtypename,
+    decltype(DerivedType::fields)::value_type const &fd, int d,
     std::string index_string, std::string indent) {
 
   if (d == 0) { // we actually print a row
@@ -260,8 +535,8 @@ void FortranPrintArrayRecursiveHelper(
 {0}  write (*, "({7})", advance='no') {4}%{5}({6})
 {0}end do)-",
              indent, indent.substr(0, indent.size() - 2), char('i' + d),
-             fd.get_dim_size(d, parameters), dtypename, fd.name, index_string,
-             FortranPrintFormatSpecifier[fd.type]);
+             fd.get_dim_size(d), dtypename, fd.name, index_string,
+             FortranPrintFormatSpecifier.at(fd.type));
 
   } else {
     os.print(R"-(
@@ -269,9 +544,9 @@ void FortranPrintArrayRecursiveHelper(
 {0}  write (*,"(A,I3X,A)"{4}) "{1}", {2}, ": ["
 )-",
              indent, indent.substr(0, indent.size() - 2), char('i' + d),
-             fd.get_dim_size(d, parameters), (d == 1) ? ",advance='no'" : "");
-    FortranPrintArrayRecursiveHelper(os, dtypename, parameters, fd, d - 1,
-                                     index_string, indent + "  ");
+             fd.get_dim_size(d), (d == 1) ? ",advance='no'" : "");
+    FortranPrintArrayRecursiveHelper(os, dtypename, fd, d - 1, index_string,
+                                     indent + "  ");
 
     os.print(R"-(
 {0}  write (*,"(A)") "{1}  ],"
@@ -281,25 +556,39 @@ void FortranPrintArrayRecursiveHelper(
   }
 }
 
-void FortranDerivedTypeInstancePrint(fmt::ostream &os,
+void FortranDerivedTypeInstancePrint(OutputBuffer &os,
                                      std::string const &dtypename,
-                                     ParameterFields const &parameters,
-                                     decltype(DerivedTypes::mapped_type::fields)
-                                         const &fields) {
+                                     DerivedType const &dtype) {
+
+  // seqlocked types print a copy taken under the lock
+  std::string print_copy = "";
+  if (dtype.is_seqlocked()) {
+    print_copy = fmt::format(
+        "{}      type (t_{}) :: fmg_inst\n\n{}", FortranSeqLockDecl(dtype),
+        dtypename,
+        FortranSeqLockRead(dtypename, dtype,
+                           fmt::format("      fmg_inst = {}\n",
+                                       FortranInstance(dtypename, dtype))));
+  }
 
   os.print(R"(
-    subroutine print_{0}()  bind(C, name='print_{0}')
+    subroutine print_{0}({1})  bind(C, name='print_{0}')
       implicit integer(i-z)
-
+{2}{3}
       write (*,*) "{0}:"
 )",
-           dtypename);
+           dtypename, FortranInstanceDummy(dtype, false),
+           FortranInstanceDecl(dtype), print_copy);
 
-  for (auto const &fd : fields) {
+  auto instname = FortranInstance(dtypename, dtype);
+  if (dtype.is_seqlocked()) {
+    instname = "fmg_inst";
+  }
+  for (auto const &fd : dtype.fields) {
 
     if (fd.is_array() && !fd.is_string()) {
       os.print(R"-(      write (*,"(A)"{3}) "  {1} :: {0}({2})")-", fd.name,
-               to_string(fd.type), fd.get_fort_shape_str(parameters),
+               to_string(fd.type), fd.get_fort_shape_str(),
                (fd.size.size() > 1) ? "" : ",advance='no'");
 
       std::stringstream index_string("");
@@ -317,9 +606,8 @@ void FortranDerivedTypeInstancePrint(fmt::ostream &os,
 )-");
       }
 
-      FortranPrintArrayRecursiveHelper(os, dtypename, parameters, fd,
-                                       (fd.size.size() - 1), index_string.str(),
-                                       "      ");
+      FortranPrintArrayRecursiveHelper(os, instname, fd, (fd.size.size() - 1),
+                                       index_string.str(), "      ");
       os.print(R"-(
       write (*,"(A)") "  ]"
 
@@ -329,8 +617,8 @@ void FortranDerivedTypeInstancePrint(fmt::ostream &os,
       os.print(R"-(      write (*,"(A,{3})") "  {1}({2}): ", {0}%{1}
 
 )-",
-               dtypename, fd.name, to_string(fd.type),
-               FortranPrintFormatSpecifier[fd.type]);
+               instname, fd.name, to_string(fd.type),
+               FortranPrintFormatSpecifier.at(fd.type));
     }
   }
 
@@ -341,83 +629,1089 @@ void FortranDerivedTypeInstancePrint(fmt::ostream &os,
            dtypename);
 }
 
-void FortranDerivedTypeInstanceAccessors(fmt::ostream &os,
-                                         std::string const &dtypename) {
+void FortranDerivedTypeInstanceAccessors(OutputBuffer &os,
+                                         std::string const &dtypename,
+                                         DerivedType const &dtype) {
 
   os.print(R"(
-    subroutine copy_{0}(cinst) bind(C, name='copy_{0}')
-      type (c_ptr), value :: cinst
+    subroutine copy_{0}({2}cinst) bind(C, name='copy_{0}')
+{3}      type (c_ptr), value :: cinst
       type (t_{0}), pointer :: finst
-
+{6}
       call C_F_POINTER(cinst,finst)
 
-      finst = {0}
-    end subroutine copy_{0}
+{7}    end subroutine copy_{0}
 
-    subroutine update_{0}(cinst) bind(C, name='update_{0}')
-      type (c_ptr), value :: cinst
+    subroutine update_{0}({2}cinst) bind(C, name='update_{0}')
+{3}      type (c_ptr), value :: cinst
       type (t_{0}), pointer :: finst
-
+{6}
       call C_F_POINTER(cinst,finst)
 
-      {0} = finst
-    end subroutine update_{0}
+{4}{8}      {1} = finst
+      {0}_version = {0}_version + 1
+{9}    end subroutine update_{0}
+
+    subroutine touch_{0}() bind(C, name='touch_{0}')
+{10}{5}{8}      {0}_version = {0}_version + 1
+{9}    end subroutine touch_{0}
     )",
+           dtypename, FortranInstance(dtypename, dtype),
+           FortranInstanceDummy(dtype), FortranInstanceDecl(dtype),
+           FortranWriteCheck(dtypename, dtype, "update_" + dtypename),
+           FortranWriteCheck(dtypename, dtype, "touch_" + dtypename),
+           FortranSeqLockDecl(dtype),
+           FortranSeqLockRead(dtypename, dtype,
+                              fmt::format("      finst = {}\n",
+                                          FortranInstance(dtypename, dtype))),
+           FortranSeqLockWriteBegin(dtypename, dtype),
+           FortranSeqLockWriteEnd(dtypename, dtype),
+           dtype.is_seqlocked() ? FortranSeqLockDecl(dtype) + "\n" : "");
+}
+
+void FortranDerivedTypeHotColdAccessors(OutputBuffer &os,
+                                        std::string const &dtypename,
+                                        DerivedType const &dtype) {
+  for (auto const &part : {"hot", "cold"}) {
+    auto part_type = dtype.get_hot_cold_part(std::string(part) == "hot");
+    if (!part_type.fields.size()) {
+      continue;
+    }
+
+    std::string copy_fields = "", update_fields = "";
+    for (auto const &fd : part_type.fields) {
+      copy_fields += fmt::format("      finst%{0} = {1}%{0}\n", fd.name,
+                                 FortranInstance(dtypename, dtype));
+      update_fields += fmt::format("      {1}%{0} = finst%{0}\n", fd.name,
+                                   FortranInstance(dtypename, dtype));
+    }
+
+    os.print(R"(
+    subroutine copy_{0}_{1}({2}cinst) bind(C, name='copy_{0}_{1}')
+{3}      type (c_ptr), value :: cinst
+      type (t_{0}_{1}), pointer :: finst
+{7}
+      call C_F_POINTER(cinst,finst)
+
+{4}    end subroutine copy_{0}_{1}
+
+    subroutine update_{0}_{1}({2}cinst) bind(C, name='update_{0}_{1}')
+{3}      type (c_ptr), value :: cinst
+      type (t_{0}_{1}), pointer :: finst
+{7}
+      call C_F_POINTER(cinst,finst)
+
+{6}{8}{5}      {0}_version = {0}_version + 1
+{9}    end subroutine update_{0}_{1}
+)",
+             dtypename, part, FortranInstanceDummy(dtype),
+             FortranInstanceDecl(dtype),
+             FortranSeqLockRead(dtypename, dtype, copy_fields), update_fields,
+             FortranWriteCheck(dtypename, dtype,
+                               fmt::format("update_{}_{}", dtypename, part)),
+             FortranSeqLockDecl(dtype),
+             FortranSeqLockWriteBegin(dtypename, dtype),
+             FortranSeqLockWriteEnd(dtypename, dtype));
+  }
+}
+
+void FortranDerivedTypeFieldAccessors(OutputBuffer &os,
+                                      std::string const &dtypename,
+                                      DerivedType const &dtype,
+                                      FieldDescriptor const &fd) {
+
+  auto ftype =
+      fmt::format("{}(kind={})", FortranFieldTypes.at(fd.type),
+                  FortranFieldKinds.at(fd.type));
+  auto write_check = FortranWriteCheck(
+      dtypename, dtype, fmt::format("set_{}_{}", dtypename, fd.name));
+  auto instance = FortranInstance(dtypename, dtype);
+  auto lock_decl = FortranSeqLockDecl(dtype);
+  auto lock_begin = FortranSeqLockWriteBegin(dtypename, dtype);
+  auto lock_end = FortranSeqLockWriteEnd(dtypename, dtype);
+
+  if (!fd.is_array()) {
+    os.print(R"(
+    function get_{0}_{1}({6}) bind(C, name='get_{0}_{1}') result(val)
+{7}      {2} :: val
+{9}
+{3}    end function get_{0}_{1}
+
+    subroutine set_{0}_{1}({5}val) bind(C, name='set_{0}_{1}')
+{7}      {2}, value :: val
+{9}
+{8}{10}      {4}%{1} = val
+      {0}_version = {0}_version + 1
+{11}    end subroutine set_{0}_{1}
+)",
+             dtypename, fd.name, ftype,
+             FortranSeqLockRead(dtypename, dtype,
+                                fmt::format("      val = {}%{}\n",
+                                            instance, fd.name)),
+             instance, FortranInstanceDummy(dtype),
+             FortranInstanceDummy(dtype, false), FortranInstanceDecl(dtype),
+             write_check, lock_decl, lock_begin, lock_end);
+    return;
+  }
+
+  // strings already have Fortran get_/set_ helpers, so only the element and
+  // slice-wise accessors are emitted for them
+  if (!fd.is_string()) {
+    os.print(R"(
+    subroutine get_{0}_{1}({5}out) bind(C, name='get_{0}_{1}')
+{7}      {2}, dimension({3}), intent(out) :: out
+{9}
+{6}    end subroutine get_{0}_{1}
+
+    subroutine set_{0}_{1}({5}in) bind(C, name='set_{0}_{1}')
+{7}      {2}, dimension({3}), intent(in) :: in
+{9}
+{8}{10}      {4}%{1} = in
+      {0}_version = {0}_version + 1
+{11}    end subroutine set_{0}_{1}
+)",
+             dtypename, fd.name, ftype, FortranDimensionList(fd), instance,
+             FortranInstanceDummy(dtype),
+             FortranSeqLockRead(dtypename, dtype,
+                                fmt::format("      out = {}%{}\n", instance,
+                                            fd.name)),
+             FortranInstanceDecl(dtype), write_check, lock_decl, lock_begin,
+             lock_end);
+  }
+
+  // element and slice accessors use 0-based offsets into the field storage,
+  // which is laid out identically in both languages. Offsets outside of the
+  // field stop with an error instead of reaching into neighbouring fields.
+  os.print(R"(
+    function get_{0}_{1}_elem({5}idx) bind(C, name='get_{0}_{1}_elem') result(val)
+{7}      integer(kind=C_INT), value :: idx
+      {2} :: val
+      {2}, pointer :: flat(:)
+{10}
+      call fmg_check_range('get_{0}_{1}_elem', idx, 1, {3})
+      flat(1:{3}) => {4}%{1}
+{12}    end function get_{0}_{1}_elem
+
+    subroutine set_{0}_{1}_elem({5}idx, val) bind(C, name='set_{0}_{1}_elem')
+{7}      integer(kind=C_INT), value :: idx
+      {2}, value :: val
+      {2}, pointer :: flat(:)
+{10}
+{8}      call fmg_check_range('set_{0}_{1}_elem', idx, 1, {3})
+      flat(1:{3}) => {4}%{1}
+{11}      flat(idx+1) = val
+      {0}_version = {0}_version + 1
+{14}    end subroutine set_{0}_{1}_elem
+
+    subroutine get_{0}_{1}_slice({5}first, count, out) &
+&       bind(C, name='get_{0}_{1}_slice')
+{7}      integer(kind=C_INT), value :: first, count
+      {2}, dimension(count), intent(out) :: out
+      {2}, pointer :: flat(:)
+{10}
+      call fmg_check_range('get_{0}_{1}_slice', first, count, {3})
+      flat(1:{3}) => {4}%{1}
+{13}    end subroutine get_{0}_{1}_slice
+
+    subroutine set_{0}_{1}_slice({5}first, count, in) &
+&       bind(C, name='set_{0}_{1}_slice')
+{7}      integer(kind=C_INT), value :: first, count
+      {2}, dimension(count), intent(in) :: in
+      {2}, pointer :: flat(:)
+{10}
+{9}      call fmg_check_range('set_{0}_{1}_slice', first, count, {3})
+      flat(1:{3}) => {4}%{1}
+{11}      flat(first+1:first+count) = in
+      {0}_version = {0}_version + 1
+{14}    end subroutine set_{0}_{1}_slice
+)",
+           dtypename, fd.name, ftype, fd.get_storage_size(), instance,
+           FortranInstanceDummy(dtype), FortranInstanceDummy(dtype, false),
+           FortranInstanceDecl(dtype),
+           FortranWriteCheck(dtypename, dtype,
+                             fmt::format("set_{}_{}_elem", dtypename,
+                                         fd.name)),
+           FortranWriteCheck(dtypename, dtype,
+                             fmt::format("set_{}_{}_slice", dtypename,
+                                         fd.name)),
+           lock_decl, lock_begin,
+           FortranSeqLockRead(dtypename, dtype, "      val = flat(idx+1)\n"),
+           FortranSeqLockRead(dtypename, dtype,
+                              "      out = flat(first+1:first+count)\n"),
+           lock_end);
+}
+
+void FortranThreadPrivateInstanceAccessors(OutputBuffer &os,
+                                           std::string const &dtypename) {
+
+  os.print(R"(
+    function instance_ptr_{0}() bind(C, name='instance_ptr_{0}') result(ptr)
+      type (c_ptr) :: ptr
+
+      ptr = C_LOC({0})
+    end function instance_ptr_{0}
+
+    function version_ptr_{0}() bind(C, name='version_ptr_{0}') result(ptr)
+      type (c_ptr) :: ptr
+
+      ptr = C_LOC({0}_version)
+    end function version_ptr_{0}
+)",
            dtypename);
 }
 
-void FortranFileFooter(fmt::ostream &os, std::string const &modname) {
+// The C++ interface holds the write lock of a seqlocked type across a whole
+// read-modify-write, during which it accesses the instance through this
+void FortranSeqLockInstancePointer(OutputBuffer &os,
+                                   std::string const &dtypename) {
+
+  os.print(R"(
+    function instance_ptr_{0}() bind(C, name='instance_ptr_{0}') result(ptr)
+      type (c_ptr) :: ptr
+
+      ptr = C_LOC({0})
+    end function instance_ptr_{0}
+)",
+           dtypename);
+}
+
+void FortranDerivedTypeMaskedUpdate(OutputBuffer &os,
+                                    std::string const &dtypename,
+                                    DerivedType const &dtype) {
+
+  auto const &fields = dtype.fields;
+  os.print(R"(
+    subroutine update_{0}_masked({2}cinst, mask) &
+&       bind(C, name='update_{0}_masked')
+{3}      type (c_ptr), value :: cinst
+      integer(kind=C_INT64_T), dimension({1}), intent(in) :: mask
+      type (t_{0}), pointer :: finst
+{5}
+      call C_F_POINTER(cinst,finst)
+
+{4}{6})",
+           dtypename, (fields.size() + 63) / 64, FortranInstanceDummy(dtype),
+           FortranInstanceDecl(dtype),
+           FortranWriteCheck(dtypename, dtype,
+                             fmt::format("update_{}_masked", dtypename)),
+           FortranSeqLockDecl(dtype),
+           FortranSeqLockWriteBegin(dtypename, dtype));
+
+  // bit i%64 of mask word i/64 flags field i as modified
+  for (size_t i = 0; i < fields.size(); ++i) {
+    os.print("      if (btest(mask({}), {})) {}%{} = finst%{}\n", (i / 64) + 1,
+             i % 64, FortranInstance(dtypename, dtype), fields[i].name,
+             fields[i].name);
+  }
+
+  os.print("      {0}_version = {0}_version + 1\n"
+           "{1}    end subroutine update_{0}_masked\n",
+           dtypename, FortranSeqLockWriteEnd(dtypename, dtype));
+}
+
+// "FMGSNAP1" read as a little-endian 64 bit integer, starts every snapshot
+int64_t const kSnapshotMagic = 3553411910655757638;
+
+// bytes before the instances in a shared memory segment: the snapshot header,
+// the modification counter and padding to keep the instances aligned
+int const kSegmentHeaderSize = 64;
+
+// The segment is opened and mapped by the C support file of the module, see
+// FortranSharedMemorySupport, so the flag values and atomics come from the
+// headers of the machine that compiles it. The bindings are shared with the
+// modules of split output.
+void FortranSharedMemoryInterfaces(OutputBuffer &os,
+                                   std::string const &modname) {
+  os.print(R"(
+  ! implemented in the C support file of the module
+  interface
+    function fmg_shm_map(name, writer, length, segment) &
+&       bind(C, name='{0}_shm_map')
+      import :: c_ptr, C_CHAR, C_INT, C_SIZE_T
+      character(kind=C_CHAR), dimension(*), intent(in) :: name
+      integer(kind=C_INT), value :: writer
+      integer(kind=C_SIZE_T), value :: length
+      type (c_ptr), intent(out) :: segment
+      integer(kind=C_INT) :: fmg_shm_map
+    end function fmg_shm_map
+
+    function fmg_shm_unmap(segment, length) bind(C, name='{0}_shm_unmap')
+      import :: c_ptr, C_SIZE_T, C_INT
+      type (c_ptr), value :: segment
+      integer(kind=C_SIZE_T), value :: length
+      integer(kind=C_INT) :: fmg_shm_unmap
+    end function fmg_shm_unmap
+
+    function fmg_shm_unlink(name) bind(C, name='{0}_shm_unlink')
+      import :: C_CHAR, C_INT
+      character(kind=C_CHAR), dimension(*), intent(in) :: name
+      integer(kind=C_INT) :: fmg_shm_unlink
+    end function fmg_shm_unlink
+
+    function fmg_shm_load_acquire(ptr) bind(C, name='{0}_shm_load_acquire')
+      import :: c_ptr, C_INT64_T
+      type (c_ptr), value :: ptr
+      integer(kind=C_INT64_T) :: fmg_shm_load_acquire
+    end function fmg_shm_load_acquire
+
+    subroutine fmg_shm_store_release(ptr, val) &
+&       bind(C, name='{0}_shm_store_release')
+      import :: c_ptr, C_INT64_T
+      type (c_ptr), value :: ptr
+      integer(kind=C_INT64_T), value :: val
+    end subroutine fmg_shm_store_release
+  end interface
+)",
+           modname);
+}
+
+// Opens, sizes and maps the segment with the flag values of the compiling
+// machine. A reader can open the segment between the writer's shm_open and
+// ftruncate, so the size is checked before mapping, as touching a mapping
+// beyond the end of its file raises SIGBUS.
+void FortranSharedMemorySupport(OutputBuffer &os, std::string const &modname) {
+  os.print(R"(//Generated by FortModGen, do not edit.
+//Content hash (FNV-1a): {1}
+
+//Shared memory support for the types of module {0} with shm storage, called
+//by the Fortran module. Compile it into the same library as the module.
+
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//Maps the named segment, which the writer creates and sizes first. Returns
+//one of the FORTMODGEN_IO_ status codes, a segment that is still shorter
+//than length has not been published yet.
+int {0}_shm_map(char const *name, int writer, size_t length,
+                void **segment) {{
+  struct stat st;
+  void *addr;
+  int fd = writer ? shm_open(name, O_RDWR | O_CREAT, 0600)
+                  : shm_open(name, O_RDONLY, 0);
+  *segment = NULL;
+  if (fd < 0) {{
+    return 1;
+  }}
+  if (writer && (ftruncate(fd, (off_t)length) != 0)) {{
+    close(fd);
+    return 3;
+  }}
+  if (fstat(fd, &st) != 0) {{
+    close(fd);
+    return 3;
+  }}
+  if ((size_t)st.st_size < length) {{
+    close(fd);
+    return 2;
+  }}
+  addr = mmap(NULL, length, writer ? (PROT_READ | PROT_WRITE) : PROT_READ,
+              MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {{
+    return 3;
+  }}
+  *segment = addr;
+  return 0;
+}}
+
+int {0}_shm_unmap(void *segment, size_t length) {{
+  return munmap(segment, length);
+}}
+
+int {0}_shm_unlink(char const *name) {{
+  return shm_unlink(name);
+}}
+
+//The magic of the segment header is published with release and checked with
+//acquire ordering
+int64_t {0}_shm_load_acquire(int64_t const *ptr) {{
+  return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}}
+
+void {0}_shm_store_release(int64_t *ptr, int64_t val) {{
+  __atomic_store_n(ptr, val, __ATOMIC_RELEASE);
+}}
+)",
+           modname, kContentHashPlaceholder);
+}
+
+// The lock helpers of seqlocked types are C functions of the module's C
+// support file, see FortranSeqLockSupport, so that Fortran and C++ share one
+// implementation with acquire and release ordering. The bindings are shared
+// with the modules of split output.
+void FortranSeqLockInterfaces(OutputBuffer &os, std::string const &modname) {
+  os.print(R"(
+  ! implemented in the C support file of the module
+  interface
+    function fmg_seqlock_read_begin(lock) &
+&       bind(C, name='{0}_seqlock_read_begin')
+      import :: C_INT64_T
+      integer(kind=C_INT64_T), intent(in) :: lock
+      integer(kind=C_INT64_T) :: fmg_seqlock_read_begin
+    end function fmg_seqlock_read_begin
+
+    function fmg_seqlock_read_retry(lock, seq) &
+&       bind(C, name='{0}_seqlock_read_retry')
+      import :: C_INT, C_INT64_T
+      integer(kind=C_INT64_T), intent(in) :: lock
+      integer(kind=C_INT64_T), value :: seq
+      integer(kind=C_INT) :: fmg_seqlock_read_retry
+    end function fmg_seqlock_read_retry
+
+    function fmg_seqlock_write_begin(lock) &
+&       bind(C, name='{0}_seqlock_write_begin')
+      import :: C_INT64_T
+      integer(kind=C_INT64_T), intent(inout) :: lock
+      integer(kind=C_INT64_T) :: fmg_seqlock_write_begin
+    end function fmg_seqlock_write_begin
+
+    subroutine fmg_seqlock_write_end(lock, seq) &
+&       bind(C, name='{0}_seqlock_write_end')
+      import :: C_INT64_T
+      integer(kind=C_INT64_T), intent(inout) :: lock
+      integer(kind=C_INT64_T), value :: seq
+    end subroutine fmg_seqlock_write_end
+  end interface
+)",
+           modname);
+}
+
+// Readers never block each other, they spin while the counter is odd and
+// retry if it moved while they were reading. Writers are serialized by
+// making the counter odd with a compare and swap.
+void FortranSeqLockSupport(OutputBuffer &os, std::string const &modname) {
+  os.print(R"(//Generated by FortModGen, do not edit.
+//Content hash (FNV-1a): {1}
+
+//Sequence lock helpers for the seqlocked types of module {0}, called by the
+//Fortran module and the C++ interface. Compile it into the same library as
+//the module.
+
+#include <stdint.h>
+
+//Returns the even counter value to pass to {0}_seqlock_read_retry once the
+//instance has been read
+int64_t {0}_seqlock_read_begin(int64_t const *lock) {{
+  int64_t seq;
+  while ((seq = __atomic_load_n(lock, __ATOMIC_ACQUIRE)) & 1) {{
+  }}
+  return seq;
+}}
+
+//Nonzero if a writer was active since {0}_seqlock_read_begin returned seq,
+//the instance then has to be read again
+int {0}_seqlock_read_retry(int64_t const *lock, int64_t seq) {{
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(lock, __ATOMIC_RELAXED) != seq;
+}}
+
+//Returns the odd counter value to pass to {0}_seqlock_write_end once the
+//instance has been written
+int64_t {0}_seqlock_write_begin(int64_t *lock) {{
+  int64_t seq = __atomic_load_n(lock, __ATOMIC_RELAXED);
+  while ((seq & 1) ||
+         !__atomic_compare_exchange_n(lock, &seq, seq + 1, 1, __ATOMIC_ACQUIRE,
+                                      __ATOMIC_RELAXED)) {{
+    seq = __atomic_load_n(lock, __ATOMIC_RELAXED);
+  }}
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  return seq + 1;
+}}
+
+void {0}_seqlock_write_end(int64_t *lock, int64_t seq) {{
+  __atomic_store_n(lock, seq + 1, __ATOMIC_RELEASE);
+}}
+)",
+           modname, kContentHashPlaceholder);
+}
+
+// A writer creates (or reuses) the named segment, copies the current
+// instance into it and publishes the snapshot header last, with a release
+// store of its magic. Readers map it read-only after checking the header
+// with an acquire load, and procedures that modify the instance stop with
+// an error while attached as a reader. Both return the snapshot status
+// codes.
+void FortranDerivedTypeSharedMemory(OutputBuffer &os,
+                                    std::string const &dtypename,
+                                    DerivedType const &dtype) {
+  auto dtl = GetLayout(dtype);
+  auto size = dtl.size;
+  auto count = dtype.get_instance_count();
+  // mappings are page aligned, so the instances are as aligned as their
+  // offset
+  auto offset = std::max(kSegmentHeaderSize, dtl.alignment);
+
+  os.print(R"(
+    function attach_{0}(cname, writer) bind(C, name='attach_{0}') &
+&       result(status)
+      character(kind=C_CHAR), dimension(*), intent(in) :: cname
+      integer(kind=C_INT), value :: writer
+      integer(kind=C_INT) :: status
+      integer(kind=C_INT) :: ret
+      integer(kind=C_INT64_T), pointer :: header(:)
+      integer(kind=C_INT64_T) :: magic
+      type (c_ptr) :: segment
+
+      call detach_{0}()
+
+      status = fmg_shm_map(cname, writer, {5}_C_SIZE_T, segment)
+      if (status.ne.0) then
+        return
+      end if
+
+      call C_F_POINTER(segment, header, [{6}])
+      if (writer.eq.0) then
+        ! pairs with the release store of the writer, the rest of the header
+        ! and the instance are complete once the magic is seen
+        magic = fmg_shm_load_acquire(segment)
+        if (any([magic, header(2:4)].ne.[{1}_C_INT64_T, {2}_C_INT64_T, &
+&                                       {3}_C_INT64_T, {4}_C_INT64_T])) then
+          ret = fmg_shm_unmap(segment, {5}_C_SIZE_T)
+          status = 2
+          return
+        end if
+      end if
+
+      {0}_segment = segment
+      call C_F_POINTER(C_LOC(header(5)), {0}_version)
+      call C_F_POINTER(transfer(transfer(segment, 0_C_INTPTR_T) + &
+&       {7}_C_INTPTR_T, segment), {0}{8})
+
+      if (writer.ne.0) then
+        header(1:4) = 0
+        {0}_version = {0}_version_local + 1
+        {0} = {0}_local
+        header(2:4) = [{2}_C_INT64_T, {3}_C_INT64_T, {4}_C_INT64_T]
+        call fmg_shm_store_release(segment, {1}_C_INT64_T)
+      end if
+      {0}_readonly = (writer.eq.0)
+      status = 0
+    end function attach_{0}
+
+    subroutine detach_{0}() bind(C, name='detach_{0}')
+      integer(kind=C_INT) :: ret
+
+      if (.not.C_ASSOCIATED({0}_segment)) then
+        return
+      end if
+
+      ! keep the last contents seen, flagged as modified
+      {0}_local = {0}
+      {0}_version_local = {0}_version + 1
+      {0} => {0}_local
+      {0}_version => {0}_version_local
+
+      ret = fmg_shm_unmap({0}_segment, {5}_C_SIZE_T)
+      {0}_segment = C_NULL_PTR
+      {0}_readonly = .false.
+    end subroutine detach_{0}
+
+    ! removes the named segment, processes that have it mapped keep using it
+    ! until they detach
+    function unlink_{0}_shm(cname) bind(C, name='unlink_{0}_shm') &
+&       result(status)
+      character(kind=C_CHAR), dimension(*), intent(in) :: cname
+      integer(kind=C_INT) :: status
+
+      status = 0
+      if (fmg_shm_unlink(cname).ne.0) then
+        status = 1
+      end if
+    end function unlink_{0}_shm
+
+    subroutine check_writable_{0}(procname)
+      character(len=*), intent(in) :: procname
+
+      if ({0}_readonly) then
+        write (*,*) "[ERROR]: ", procname, " modifies {0}, ", &
+&         "which is attached read-only."
+        error stop 1
+      end if
+    end subroutine check_writable_{0}
+
+    function writable_instance_ptr_{0}() &
+&       bind(C, name='writable_instance_ptr_{0}') result(ptr)
+      type (c_ptr) :: ptr
+
+      call check_writable_{0}('instance')
+      ptr = C_LOC({0})
+    end function writable_instance_ptr_{0}
+
+    function instance_ptr_{0}() bind(C, name='instance_ptr_{0}') result(ptr)
+      type (c_ptr) :: ptr
+
+      ptr = C_LOC({0})
+    end function instance_ptr_{0}
+
+    function version_ptr_{0}() bind(C, name='version_ptr_{0}') result(ptr)
+      type (c_ptr) :: ptr
+
+      ptr = C_LOC({0}_version)
+    end function version_ptr_{0}
+)",
+           dtypename, kSnapshotMagic,
+           GetLayoutHash(dtypename, dtype), size, count,
+           offset + size * count, kSegmentHeaderSize / 8, offset,
+           dtype.is_instance_array() ? fmt::format(", [{}]", dtype.instances)
+                                     : "");
+}
+
+// Module procedures used by every type, emitted once per module
+void FortranCommonHelpers(OutputBuffer &os) {
+  os.print(R"(
+    function c_path_to_string(cpath) result(path)
+      character(kind=C_CHAR), dimension(*), intent(in) :: cpath
+      character(len=:), allocatable :: path
+      integer :: n
+
+      n = 0
+      do while (cpath(n+1).ne.C_NULL_CHAR)
+        n = n + 1
+      end do
+
+      allocate(character(len=n) :: path)
+      path = transfer(cpath(1:n), path)
+    end function c_path_to_string
+
+    subroutine fmg_check_range(procname, first, count, extent)
+      character(len=*), intent(in) :: procname
+      integer(kind=C_INT), intent(in) :: first, count, extent
+
+      if ((first.lt.0) .or. (count.lt.0) .or. (first.gt.extent - count)) then
+        write (*,'(A,A,A,I0,A,I0,A,I0,A)') "[ERROR]: ", procname, &
+&         " accessed ", count, " elements from offset ", first, &
+&         " of a field with ", extent, " elements."
+        error stop 1
+      end if
+    end subroutine fmg_check_range
+
+    subroutine fmg_check_offset(component, offset, expected, nbad)
+      character(len=*), intent(in) :: component
+      integer(kind=C_INTPTR_T), intent(in) :: offset
+      integer, intent(in) :: expected
+      integer(kind=C_INT), intent(inout) :: nbad
+
+      if (offset.ne.expected) then
+        write (*,'(A,A,A,I0,A,I0,A)') "[ERROR]: ", component, &
+&         " is at offset ", offset, ", the C interface expects ", &
+&         expected, "."
+        nbad = nbad + 1
+      end if
+    end subroutine fmg_check_offset
+)");
+}
+
+// Snapshots are a header of four 64 bit integers: magic, layout hash,
+// instance size and instance count, followed by the raw bytes of all
+// instances. Both procedures return 0 on success, 1 if the file could not be
+// opened, 2 if it holds a different layout and 3 on any other I/O error.
+// write_<type>_snapshot writes the instances at src, so that a caller can
+// take a consistent copy first. A load only replaces the instance, and bumps
+// its counter, once the whole file has been read.
+void FortranDerivedTypeSnapshot(OutputBuffer &os, std::string const &dtypename,
+                                DerivedType const &dtype) {
+  auto size = GetLayout(dtype).size;
+  auto count = dtype.get_instance_count();
+
+  // seqlocked types write a copy taken under the lock, so that a retried
+  // read does not rewrite the file
+  auto save_body = fmt::format(
+      "\n      status = write_{}_snapshot(cpath, C_LOC({}))\n", dtypename,
+      dtypename);
+  if (dtype.is_seqlocked()) {
+    save_body = fmt::format(R"(      type (t_{0}), allocatable, target :: saved{1}
+{3}
+      allocate(saved{2})
+{4}      status = write_{0}_snapshot(cpath, C_LOC(saved))
+)",
+                            dtypename,
+                            dtype.is_instance_array() ? "(:)" : "",
+                            dtype.is_instance_array()
+                                ? fmt::format("({})", count)
+                                : "",
+                            FortranSeqLockDecl(dtype),
+                            FortranSeqLockRead(dtypename, dtype,
+                                               fmt::format("      saved = {}\n",
+                                                           dtypename)));
+  }
+
+  os.print(R"(
+    function write_{0}_snapshot(cpath, src) &
+&       bind(C, name='write_{0}_snapshot') result(status)
+      character(kind=C_CHAR), dimension(*), intent(in) :: cpath
+      type (c_ptr), value :: src
+      integer(kind=C_INT) :: status
+      character(kind=C_CHAR), pointer :: bytes(:)
+      integer :: unit, ios
+
+      open(newunit=unit, file=c_path_to_string(cpath), access='stream', &
+&          form='unformatted', status='replace', action='write', iostat=ios)
+      if (ios.ne.0) then
+        status = 1
+        return
+      end if
+
+      call C_F_POINTER(src, bytes, [{3}*{4}])
+      write (unit, iostat=ios) {1}_C_INT64_T, {2}_C_INT64_T, &
+&       {3}_C_INT64_T, {4}_C_INT64_T, bytes
+      status = merge(0, 3, ios.eq.0)
+      close(unit)
+    end function write_{0}_snapshot
+
+    function save_{0}(cpath) bind(C, name='save_{0}') result(status)
+      character(kind=C_CHAR), dimension(*), intent(in) :: cpath
+      integer(kind=C_INT) :: status
+{8}    end function save_{0}
+
+    function load_{0}(cpath) bind(C, name='load_{0}') result(status)
+      character(kind=C_CHAR), dimension(*), intent(in) :: cpath
+      integer(kind=C_INT) :: status
+      character(kind=C_CHAR), pointer :: bytes(:)
+      integer(kind=C_INT64_T), dimension(4) :: header
+      type (t_{0}), allocatable, target :: loaded{5}
+      integer :: unit, ios
+{9}
+{7}      open(newunit=unit, file=c_path_to_string(cpath), access='stream', &
+&          form='unformatted', status='old', action='read', iostat=ios)
+      if (ios.ne.0) then
+        status = 1
+        return
+      end if
+
+      read (unit, iostat=ios) header
+      if (ios.ne.0) then
+        status = 3
+      else if (any(header.ne.[{1}_C_INT64_T, {2}_C_INT64_T, &
+&                             {3}_C_INT64_T, {4}_C_INT64_T])) then
+        status = 2
+      else
+        allocate(loaded{6})
+        call C_F_POINTER(C_LOC(loaded), bytes, [{3}*{4}])
+        read (unit, iostat=ios) bytes
+        status = merge(0, 3, ios.eq.0)
+        if (status.eq.0) then
+{10}          {0} = loaded
+          {0}_version = {0}_version + 1
+{11}        end if
+      end if
+      close(unit)
+    end function load_{0}
+)",
+           dtypename, kSnapshotMagic, GetLayoutHash(dtypename, dtype), size,
+           count, dtype.is_instance_array() ? "(:)" : "",
+           dtype.is_instance_array() ? fmt::format("({})", count) : "",
+           FortranWriteCheck(dtypename, dtype,
+                             fmt::format("load_{}", dtypename)),
+           save_body, FortranSeqLockDecl(dtype),
+           FortranSeqLockWriteBegin(dtypename, dtype, "          "),
+           FortranSeqLockWriteEnd(dtypename, dtype, "          "));
+}
+
+void FortranFileFooter(OutputBuffer &os, std::string const &modname) {
   os.print("\nend module {}\n", modname);
 }
 
-void GenerateFortranModule(std::string const &fname, std::string const &modname,
-                           ParameterFields const &parameters,
-                           DerivedTypes const &dtypes,
-                           std::vector<std::string> const &Uses) {
+// Declarations of a type, its instance and the instance's initialization
+void FortranDerivedTypeSpecification(OutputBuffer &os,
+                                     std::string const &dtypename,
+                                     DerivedType const &dtype) {
 
-  auto out = fmt::output_file(fname);
+  FortranDerivedTypeHeader(os, dtypename, dtype.comment);
 
-  FortranFileHeader(out, modname, Uses);
+  FortranDerivedTypeFields(os, dtype);
 
-  FortranModuleParameters(out, parameters);
+  FortranDerivedTypeFooter(os, dtypename, dtype);
 
-  for (auto const &dt : dtypes) {
+  FortranDerivedTypeLayoutCheck(os, dtypename, dtype);
 
-    FortranDerivedTypeHeader(out, dt.first, dt.second.comment);
+  if (dtype.has_hot_fields()) {
+    FortranDerivedTypeHotColdParts(os, dtypename, dtype);
+  }
 
-    for (auto const &fd : dt.second.fields) {
+  // arrays of instances are initialized by their type definition
+  if (dtype.is_instance_array()) {
+    return;
+  }
+
+  // instance data initialization must come after the instance declaration
+  for (auto const &fd : dtype.fields) {
 
-      FortranDerivedTypeField(out, fd, parameters);
+    if (!fd.data.size() && !fd.is_string()) {
+      continue;
     }
 
-    FortranDerivedTypeFooter(out, dt.first);
+    FortranDerivedTypeFieldData(
+        os, dtypename + (dtype.is_shared() ? "_local" : ""), fd);
+  }
+}
 
-    // instance data initialization must come after the instance declaration
-    for (auto const &fd : dt.second.fields) {
+// Runtime counterpart of the size check in the specification part, field
+// offsets are not constant expressions in Fortran
+void FortranDerivedTypeOffsetCheck(OutputBuffer &os,
+                                   std::string const &dtypename,
+                                   DerivedType const &dtype) {
+  auto dtl = GetLayout(dtype);
+  std::string checks = "";
+  for (size_t i = 0; i < dtype.fields.size(); ++i) {
+    checks += fmt::format(
+        "      call fmg_check_offset('t_{0}%{1}', &\n"
+        "&       transfer(c_loc(probe%{1}), base) - base, {2}, nbad)\n",
+        dtypename, dtype.fields[i].name, dtl.fields[i].offset);
+  }
 
-      if (!fd.data.size() && !fd.is_string()) {
-        continue;
-      }
+  if (dtype.has_explicit_padding()) {
+    checks += fmt::format(R"(
+      base = transfer(c_loc({1}), base)
+      if (mod(base, {2}_C_INTPTR_T).ne.0) then
+        write (*,'(A,I0,A)') "[ERROR]: {0} is not aligned to ", {2}, &
+&         " bytes, which the C interface expects."
+        nbad = nbad + 1
+      end if
+)",
+                          dtypename, FortranInstance(dtypename, dtype, "1"),
+                          dtl.alignment);
+  }
+
+  os.print(R"(
+    ! number of fields of t_{0} whose offset differs from the C struct, and
+    ! of misaligned instances
+    function check_{0}_layout() &
+&       bind(C, name='check_{0}_layout') result(nbad)
+      integer(kind=C_INT) :: nbad
+      type (t_{0}), allocatable, target :: probe
+      integer(kind=C_INTPTR_T) :: base
+
+      allocate(probe)
+      base = transfer(c_loc(probe), base)
+      nbad = 0
+{1}    end function check_{0}_layout
+)",
+           dtypename, checks);
+}
+
+// Module procedures of a type, these follow the contains statement
+void FortranDerivedTypeProcedures(OutputBuffer &os,
+                                  std::string const &dtypename,
+                                  DerivedType const &dtype) {
 
-      FortranDerivedTypeFieldData(out, dt.first, fd, parameters);
+  for (auto const &fd : dtype.fields) {
+    if (!fd.is_string()) {
+      continue;
     }
+    FortranStringAccessor(os, dtypename, dtype, fd);
   }
 
-  out.print("\n  contains\n");
+  FortranDerivedTypeInstancePrint(os, dtypename, dtype);
+  FortranDerivedTypeInstanceAccessors(os, dtypename, dtype);
+  FortranDerivedTypeMaskedUpdate(os, dtypename, dtype);
+  if (dtype.has_hot_fields()) {
+    FortranDerivedTypeHotColdAccessors(os, dtypename, dtype);
+  }
+  FortranDerivedTypeSnapshot(os, dtypename, dtype);
+  FortranDerivedTypeOffsetCheck(os, dtypename, dtype);
+  if (dtype.is_shared()) {
+    FortranDerivedTypeSharedMemory(os, dtypename, dtype);
+  }
+  if (dtype.threadprivate) {
+    FortranThreadPrivateInstanceAccessors(os, dtypename);
+  }
+  if (dtype.is_seqlocked()) {
+    FortranSeqLockInstancePointer(os, dtypename);
+  }
+
+  for (auto const &fd : dtype.fields) {
+    FortranDerivedTypeFieldAccessors(os, dtypename, dtype, fd);
+  }
+}
+
+bool HasSharedTypes(DerivedTypes const &dtypes) {
   for (auto const &dt : dtypes) {
+    if (dt.second.is_shared()) {
+      return true;
+    }
+  }
+  return false;
+}
 
-    // instance data initialization must come after the instance declaration
-    for (auto const &fd : dt.second.fields) {
-      if (!fd.is_string()) {
-        continue;
-      }
-      FortranStringAccessor(out, dt.first, fd, parameters);
+bool HasSeqLockedTypes(DerivedTypes const &dtypes) {
+  for (auto const &dt : dtypes) {
+    if (dt.second.is_seqlocked()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Helpers used by the procedures of the types are not part of the interface
+// of the modules that use them
+void FortranCommonHelpersPrivate(OutputBuffer &os, DerivedTypes const &dtypes,
+                                 bool split_modules) {
+  os.print("\n  private :: c_path_to_string, fmg_check_range, "
+           "fmg_check_offset\n");
+  if (split_modules && HasSharedTypes(dtypes)) {
+    os.print("  private :: fmg_shm_map, fmg_shm_unmap, fmg_shm_unlink, &\n"
+             "&             fmg_shm_load_acquire, fmg_shm_store_release\n");
+  }
+  if (split_modules && HasSeqLockedTypes(dtypes)) {
+    os.print("  private :: fmg_seqlock_read_begin, fmg_seqlock_read_retry, &\n"
+             "&             fmg_seqlock_write_begin, fmg_seqlock_write_end\n");
+  }
+}
+
+std::vector<std::string>
+FortranModuleFiles(std::string const &outstub,
+                   std::vector<std::string> const &dtypenames,
+                   bool split_modules, bool shared_memory, bool seqlock) {
+  std::vector<std::string> files;
+  if (split_modules) {
+    files.push_back(outstub + "_common.f90");
+    for (auto const &dtypename : dtypenames) {
+      files.push_back(outstub + "_" + dtypename + ".f90");
     }
+  }
+  files.push_back(outstub + ".f90");
+  if (shared_memory) {
+    files.push_back(outstub + "_shm.c");
+  }
+  if (seqlock) {
+    files.push_back(outstub + "_seqlock.c");
+  }
+  return files;
+}
 
-    FortranDerivedTypeInstancePrint(out, dt.first, parameters,
-                                    dt.second.fields);
-    FortranDerivedTypeInstanceAccessors(out, dt.first);
+// Writes the C support files of modules with shared memory or seqlocked
+// types
+void WriteSupportFiles(std::vector<std::pair<std::string, bool>> &written,
+                       std::string const &outstub, std::string const &modname,
+                       DerivedTypes const &dtypes) {
+  if (HasSharedTypes(dtypes)) {
+    OutputBuffer support;
+    FortranSharedMemorySupport(support, modname);
+    support.StampContentHash();
+    written.emplace_back(outstub + "_shm.c",
+                         support.WriteIfChanged(outstub + "_shm.c"));
   }
+  if (HasSeqLockedTypes(dtypes)) {
+    OutputBuffer support;
+    FortranSeqLockSupport(support, modname);
+    support.StampContentHash();
+    written.emplace_back(outstub + "_seqlock.c",
+                         support.WriteIfChanged(outstub + "_seqlock.c"));
+  }
+}
+
+std::vector<std::pair<std::string, bool>>
+GenerateFortranModule(std::string const &outstub, std::string const &modname,
+                      ParameterFields const &parameters,
+                      DerivedTypes const &dtypes,
+                      std::vector<std::string> const &Uses,
+                      bool split_modules, int nthreads) {
+
+  std::vector<std::pair<std::string, bool>> written;
+
+  if (!split_modules) {
+    // every type is rendered on its own, then the parts are joined in order
+    std::vector<OutputBuffer> specs(dtypes.size()), procs(dtypes.size());
+    ParallelFor(dtypes.size(), nthreads, [&](size_t i) {
+      auto const &dt = dtypes[i];
+      FortranDerivedTypeSpecification(specs[i], dt.first, dt.second);
+      FortranDerivedTypeProcedures(procs[i], dt.first, dt.second);
+    });
+
+    OutputBuffer out;
+
+    FortranFileHeader(out, modname, Uses);
+
+    FortranModuleParameters(out, parameters);
+
+    out.append(specs);
+
+    if (HasSharedTypes(dtypes)) {
+      FortranSharedMemoryInterfaces(out, modname);
+    }
+    if (HasSeqLockedTypes(dtypes)) {
+      FortranSeqLockInterfaces(out, modname);
+    }
+
+    FortranCommonHelpersPrivate(out, dtypes, false);
+
+    out.print("\n  contains\n");
+    FortranCommonHelpers(out);
+    out.append(procs);
+
+    FortranFileFooter(out, modname);
+
+    out.StampContentHash();
+    written.emplace_back(outstub + ".f90", out.WriteIfChanged(outstub + ".f90"));
+    WriteSupportFiles(written, outstub, modname, dtypes);
+    return written;
+  }
+
+  // One module per type, using a common module with the parameters and
+  // shared helpers. The umbrella module re-exports all of them under the
+  // original module name, so changing a type only recompiles its own module
+  // and the units that use the umbrella.
+  std::string common_modname = modname + "_common";
+  auto type_uses = Uses;
+  type_uses.push_back(common_modname);
+
+  OutputBuffer common;
+  FortranFileHeader(common, common_modname, Uses);
+  FortranModuleParameters(common, parameters);
+  if (HasSharedTypes(dtypes)) {
+    FortranSharedMemoryInterfaces(common, modname);
+  }
+  if (HasSeqLockedTypes(dtypes)) {
+    FortranSeqLockInterfaces(common, modname);
+  }
+  common.print("\n  contains\n");
+  FortranCommonHelpers(common);
+  FortranFileFooter(common, common_modname);
+  common.StampContentHash();
+  written.emplace_back(outstub + "_common.f90",
+                       common.WriteIfChanged(outstub + "_common.f90"));
+
+  // the type modules are independent files, so each is written by the
+  // thread that renders it
+  written.resize(1 + dtypes.size());
+  ParallelFor(dtypes.size(), nthreads, [&](size_t i) {
+    auto const &dt = dtypes[i];
+    std::string type_modname = modname + "_" + dt.first;
+
+    OutputBuffer out;
+    FortranFileHeader(out, type_modname, type_uses);
+    FortranDerivedTypeSpecification(out, dt.first, dt.second);
+    FortranCommonHelpersPrivate(out, dtypes, true);
+    out.print("\n  contains\n");
+    FortranDerivedTypeProcedures(out, dt.first, dt.second);
+    FortranFileFooter(out, type_modname);
+
+    std::string fname = outstub + "_" + dt.first + ".f90";
+    out.StampContentHash();
+    written[1 + i] = {fname, out.WriteIfChanged(fname)};
+  });
+
+  auto umbrella_uses = type_uses;
+  for (auto const &dt : dtypes) {
+    umbrella_uses.push_back(modname + "_" + dt.first);
+  }
+
+  OutputBuffer umbrella;
+  FortranFileHeader(umbrella, modname, umbrella_uses);
+  FortranCommonHelpersPrivate(umbrella, dtypes, true);
+  FortranFileFooter(umbrella, modname);
+  umbrella.StampContentHash();
+  written.emplace_back(outstub + ".f90",
+                       umbrella.WriteIfChanged(outstub + ".f90"));
+  WriteSupportFiles(written, outstub, modname, dtypes);
 
-  FortranFileFooter(out, modname);
+  return written;
 }
@@ -4,7 +4,27 @@
 
 #include <string>
 
-void GenerateFortranModule(std::string const &fname, std::string const &modname,
-                           ParameterFields const &parameters,
-                           DerivedTypes const &dtypes,
-                           std::vector<std::string> const &Uses);
\ No newline at end of file
+// The files GenerateFortranModule writes for outstub, in the order they are
+// written. Modules with shared memory or seqlocked types also get C support
+// files.
+std::vector<std::string>
+FortranModuleFiles(std::string const &outstub,
+                   std::vector<std::string> const &dtypenames,
+                   bool split_modules, bool shared_memory, bool seqlock);
+
+// Writes module modname to <outstub>.f90. With split_modules the parameters
+// and shared helpers go to module <modname>_common in <outstub>_common.f90
+// and each type to module <modname>_<type> in <outstub>_<type>.f90, which
+// <outstub>.f90 then only re-exports. Shared memory types need the C support
+// file <outstub>_shm.c to be compiled along with the module, it opens and
+// maps their segments. Likewise seqlocked types need <outstub>_seqlock.c,
+// which implements their lock. The types are rendered on up to nthreads
+// threads.
+// Returns each file name with whether it was written, unchanged files are
+// left untouched.
+std::vector<std::pair<std::string, bool>>
+GenerateFortranModule(std::string const &outstub, std::string const &modname,
+                      ParameterFields const &parameters,
+                      DerivedTypes const &dtypes,
+                      std::vector<std::string> const &Uses,
+                      bool split_modules, int nthreads = 1);
\ No newline at end of file
@@ -2,31 +2,161 @@
 
 #include "utils.h"
 
-#include "fmt/os.h"
+#include "fmt/format.h"
 
+#include <algorithm>
 #include <map>
+#include <sstream>
 
-std::map<FieldType, std::string> CFieldTypes = {
+std::map<FieldType, std::string> const CFieldTypes = {
     {FieldType::kInteger, "int"},    {FieldType::kString, "char"},
     {FieldType::kCharacter, "char"}, {FieldType::kFloat, "float"},
     {FieldType::kDouble, "double"},  {FieldType::kBool, "_Bool"},
 };
 
-std::map<FieldType, std::string> CTypePrintfSpecifier = {
+std::map<FieldType, std::string> const CTypePrintfSpecifier = {
     {FieldType::kInteger, "%d"},   {FieldType::kString, "%s"},
     {FieldType::kCharacter, "%c"}, {FieldType::kFloat, "%.3E"},
     {FieldType::kDouble, "%.3E"},  {FieldType::kBool, "%d"},
 };
 
-void ModuleStructsHeader(fmt::ostream &os, std::string const &modname) {
+// C++ spelling of a field's element type, _Bool is C only
+std::string CPPFieldType(FieldDescriptor const &fd) {
+  return (fd.type == FieldType::kBool) ? std::string("bool")
+                                        : CFieldTypes.at(fd.type);
+}
+
+// Leading instance index argument taken by every interface of an array of
+// instances, arg is the parameter declaration or the forwarded name
+std::string CInstanceArg(DerivedType const &dtype, std::string const &arg,
+                         bool more_args = true) {
+  if (!dtype.is_instance_array()) {
+    return "";
+  }
+  return more_args ? arg + ", " : arg;
+}
+
+void GeneratedHeaderPreamble(OutputBuffer &os) {
   os.print(R"(#pragma once
 
+//Generated by FortModGen, do not edit.
+//Content hash (FNV-1a): {0}
+)",
+           kContentHashPlaceholder);
+}
+
+void ModuleStructsHeader(OutputBuffer &os, std::string const &modname) {
+  GeneratedHeaderPreamble(os);
+  os.print(R"(
+#include <assert.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef __cplusplus
+#include <stdalign.h>
+#endif
+
+#ifndef FORTMODGEN_IO_OK
+//Status codes returned by the generated save_ and load_ functions
+#define FORTMODGEN_IO_OK 0
+#define FORTMODGEN_IO_OPEN_FAILED 1
+#define FORTMODGEN_IO_LAYOUT_MISMATCH 2
+#define FORTMODGEN_IO_ERROR 3
+#endif
 
 #ifdef __cplusplus
-#include <iostream>
 #include <string>
-#include <cstring>
+
+#ifndef FORTMODGEN_VIEW
+#define FORTMODGEN_VIEW
+namespace FortMod {{
+
+//Zero-copy view of a column-major Fortran array of Rank dimensions. Extents
+//are listed in Fortran order, fastest varying first. Elements are reached
+//either Fortran style, v(i, j) with 1-based indices in Fortran order, or C
+//style, v.at(j, i) with 0-based indices in the order of the C declaration.
+template <typename T, int Rank>
+class view {{
+  template <typename, int> friend class view;
+
+  T *ptr;
+  int extents[Rank];
+
+  constexpr view(T *ptr, int const *ext) : ptr(ptr), extents{{}} {{
+    for(int d = 0; d < Rank; ++d){{
+      extents[d] = ext[d];
+    }}
+  }}
+
+public:
+  template <typename... Extents>
+  constexpr view(T *ptr, Extents... ext) : ptr(ptr), extents{{int(ext)...}} {{
+    static_assert(sizeof...(Extents) == Rank, "one extent per dimension");
+  }}
+
+  constexpr int rank() const {{ return Rank; }}
+  //Extent of the 0-based Fortran dimension dim
+  constexpr int extent(int dim) const {{ return extents[dim]; }}
+  constexpr size_t size() const {{
+    size_t n = 1;
+    for(int d = 0; d < Rank; ++d){{
+      n *= extents[d];
+    }}
+    return n;
+  }}
+
+  constexpr T *data() const {{ return ptr; }}
+  //Iteration is in memory order, the first Fortran index varies fastest
+  constexpr T *begin() const {{ return ptr; }}
+  constexpr T *end() const {{ return ptr + size(); }}
+  constexpr T &operator[](size_t i) const {{ return ptr[i]; }}
+
+  template <typename... Indices>
+  constexpr T &operator()(Indices... indices) const {{
+    static_assert(sizeof...(Indices) == Rank, "one index per dimension");
+    int const idx[] = {{int(indices)...}};
+    size_t offset = 0;
+    for(int d = Rank - 1; d >= 0; --d){{
+      assert((idx[d] >= 1) && (idx[d] <= extents[d]));
+      offset = offset * extents[d] + (idx[d] - 1);
+    }}
+    return ptr[offset];
+  }}
+
+  template <typename... Indices>
+  constexpr T &at(Indices... indices) const {{
+    static_assert(sizeof...(Indices) == Rank, "one index per dimension");
+    int const idx[] = {{int(indices)...}};
+    size_t offset = 0;
+    for(int d = 0; d < Rank; ++d){{
+      assert((idx[d] >= 0) && (idx[d] < extents[Rank - 1 - d]));
+      offset = offset * extents[Rank - 1 - d] + idx[d];
+    }}
+    return ptr[offset];
+  }}
+
+  //The contiguous Fortran section v(:, ..., :, first:last), 1-based and
+  //inclusive
+  constexpr view section(int first, int last) const {{
+    assert((first >= 1) && (first <= last) && (last <= extents[Rank - 1]));
+    view sec(ptr + (size() / extents[Rank - 1]) * (first - 1), extents);
+    sec.extents[Rank - 1] = last - first + 1;
+    return sec;
+  }}
+
+  //The contiguous Fortran section v(:, ..., :, j) of one lower rank, the C
+  //subarray [j - 1]
+  constexpr view<T, Rank - 1> slice(int j) const {{
+    static_assert(Rank > 1, "cannot slice a rank 1 view");
+    assert((j >= 1) && (j <= extents[Rank - 1]));
+    return view<T, Rank - 1>(ptr + (size() / extents[Rank - 1]) * (j - 1),
+                             static_cast<int const *>(extents));
+  }}
+}};
+
+}}
+#endif
 
 extern "C" {{
 
@@ -35,7 +165,7 @@ extern "C" {{
 )");
 }
 
-void ModuleStructsParameters(fmt::ostream &os,
+void ModuleStructsParameters(OutputBuffer &os,
                              ParameterFields const &ParameterFieldDescriptors) {
   for (auto const &p : ParameterFieldDescriptors) {
     std::string comment = SanitizeComment(p.comment, "//");
@@ -45,10 +175,10 @@ void ModuleStructsParameters(fmt::ostream &os,
     if (p.is_string()) {
       os.print("static char const * {} = \"{}\";\n", p.name, p.value);
     } else if (p.is_numeric && (p.type == FieldType::kFloat)) {
-      os.print("static {} const {} = {}f;\n", CFieldTypes[p.type], p.name,
+      os.print("static {} const {} = {}f;\n", CFieldTypes.at(p.type), p.name,
                p.value);
     } else {
-      os.print("static {} const {} = {};\n", CFieldTypes[p.type], p.name,
+      os.print("static {} const {} = {};\n", CFieldTypes.at(p.type), p.name,
                p.value);
     }
 
@@ -56,14 +186,21 @@ void ModuleStructsParameters(fmt::ostream &os,
   }
 }
 
-void ModuleStructsDerivedTypeHeader(fmt::ostream &os,
+void ModuleStructsDerivedTypeHeader(OutputBuffer &os,
                                     std::string const &dtypename,
-                                    std::string comment) {
+                                    DerivedType const &dtype) {
 
-  comment = SanitizeComment(comment, "//");
+  std::string comment = SanitizeComment(dtype.comment, "//");
   if (comment.length()) {
     os.print("//{}\n", comment);
   }
+  // threadprivate instances live in thread-local storage and shared memory
+  // instances move when attached, so both are only reachable through the
+  // generated C++ instance() accessors
+  if (dtype.has_instance_pointer()) {
+    os.print("\nstruct {}_t {{\n\n", dtypename);
+    return;
+  }
   os.print(R"(
 #ifdef FORTMODGEN_EXPOSE_GLOBAL_INSTANCE
 extern
@@ -74,20 +211,25 @@ struct {}_t {{
            dtypename);
 }
 
-void ModuleStructsDerivedTypeField(fmt::ostream &os,
-                                   std::string const &dtypename,
-                                   FieldDescriptor const &fd,
-                                   ParameterFields const &parameters) {
+void ModuleStructsDerivedTypeField(OutputBuffer &os,
+                                   FieldDescriptor const &fd) {
   std::string comment = SanitizeComment(fd.comment, "  //");
   if (comment.length()) {
     os.print("  //{}\n", comment);
   }
-  os.print("  {} {}", CFieldTypes[fd.type], fd.name);
+  // the member carries its alignment so that the struct, and every copy of
+  // it, is aligned as the offsets assume
+  if (fd.is_overaligned()) {
+    os.print("  alignas({}) ", fd.get_alignment());
+  } else {
+    os.print("  ");
+  }
+  os.print("{} {}", CFieldTypes.at(fd.type), fd.name);
 
   if (fd.is_array()) {
     for (int i = fd.size.size(); i > 0; --i) {
 
-      int dim_size = fd.get_dim_size(i - 1, parameters);
+      int dim_size = fd.get_dim_size(i - 1);
       if (fd.is_string()) {
         dim_size++;
       }
@@ -97,63 +239,246 @@ void ModuleStructsDerivedTypeField(fmt::ostream &os,
   }
   os.print(";\n");
 
+  if (fd.is_array() && !fd.is_string()) {
+    std::string extents = "", first_element = "";
+    for (size_t i = 0; i < fd.size.size(); ++i) {
+      extents += fmt::format(", {}", fd.get_dim_size(i));
+      first_element += "[0]";
+    }
+    os.print(R"(
+#ifdef __cplusplus
+  FortMod::view<{0}, {1}> view_{2}() {{
+    return FortMod::view<{0}, {1}>(&{2}{3}{4});
+  }}
+  FortMod::view<{0} const, {1}> view_{2}() const {{
+    return FortMod::view<{0} const, {1}>(&{2}{3}{4});
+  }}
+#endif
+)",
+             CFieldTypes.at(fd.type), fd.size.size(), fd.name, first_element,
+             extents);
+  }
+
   if (fd.is_string()) {
     os.print(R"(
 #ifdef __cplusplus
-  std::string get_{1}() const {{
-    size_t first_null = 0;
-    while({1}[first_null] != '\0'){{
-      first_null++;
-      if(first_null == {2}){{
-        break;
-      }}
-    }}
-    return std::string({1}, first_null); 
-  }}
-  void set_{1}(std::string in_str) {{
-    std::memset({1},'\0',{2});
-    if (in_str.size() > {2}) {{
-      std::cout
-          << "[WARN]: String: \"" << in_str
-          << "\", is too large to fit in {0}::{1}, truncated to {2} characters."
-          << std::endl;
+  //string helpers, defined in the _strings.h header
+  inline std::string get_{0}() const;
+  inline void set_{0}(std::string in_str);
+#endif
+)",
+             fd.name);
+  }
+}
+
+// Out-of-class definitions of the string member helpers of a struct, kept
+// apart so that including the structs does not pull in the iostream headers
+void ModuleStructsStringHelpers(OutputBuffer &os, std::string const &dtypename,
+                                DerivedType const &dtype) {
+  for (auto const &fd : dtype.fields) {
+    if (!fd.is_string()) {
+      continue;
+    }
+    os.print(R"(
+inline std::string {0}_t::get_{1}() const {{
+  size_t first_null = 0;
+  while({1}[first_null] != '\0'){{
+    first_null++;
+    if(first_null == {2}){{
+      break;
     }}
-    std::memcpy({1}, in_str.c_str(), std::min(size_t({2}), in_str.size()));
   }}
-#endif
+  return std::string({1}, first_null);
+}}
+
+inline void {0}_t::set_{1}(std::string in_str) {{
+  std::memset({1},'\0',{2});
+  if (in_str.size() > {2}) {{
+    std::cout
+        << "[WARN]: String: \"" << in_str
+        << "\", is too large to fit in {0}::{1}, truncated to {2} characters."
+        << std::endl;
+  }}
+  std::memcpy({1}, in_str.c_str(), std::min(size_t({2}), in_str.size()));
+}}
 )",
-             dtypename, fd.name, fd.get_size(parameters));
+             dtypename, fd.name, fd.get_size());
   }
 }
 
-void ModuleStructsDerivedTypeFooter(fmt::ostream &os,
-                                    std::string const &dtypename) {
+// Emits the fields of a type, spelling out every gap as a char array for
+// types with over-aligned fields to match the Fortran type
+void ModuleStructsDerivedTypeFields(OutputBuffer &os,
+                                    DerivedType const &dtype) {
+  auto dtl = GetLayout(dtype);
+  bool explicit_padding = dtype.has_explicit_padding();
+  for (size_t i = 0; i < dtype.fields.size(); ++i) {
+    if (explicit_padding && dtl.fields[i].padding) {
+      os.print("  char pad_{}[{}];\n", dtype.fields[i].name,
+               dtl.fields[i].padding);
+    }
+    ModuleStructsDerivedTypeField(os, dtype.fields[i]);
+  }
+  if (explicit_padding && dtl.tail_padding) {
+    os.print("  char pad_tail[{}];\n", dtl.tail_padding);
+  }
+}
+
+// Compile-time checks that the struct has the layout that the Fortran type
+// is checked against
+void ModuleStructsLayoutChecks(OutputBuffer &os, std::string const &dtypename,
+                               DerivedType const &dtype) {
+  auto dtl = GetLayout(dtype);
+  os.print("\nstatic_assert(sizeof(struct {0}_t) == {1}, \"unexpected size of "
+           "{0}_t\");\n"
+           "static_assert(alignof(struct {0}_t) == {2}, \"unexpected alignment "
+           "of {0}_t\");\n",
+           dtypename, dtl.size, dtl.alignment);
+  for (auto const &fl : dtl.fields) {
+    os.print("static_assert(offsetof(struct {0}_t, {1}) == {2}, "
+             "\"unexpected offset of {0}_t::{1}\");\n",
+             dtypename, fl.name, fl.offset);
+  }
+}
+
+void ModuleStructsDerivedTypeFooter(OutputBuffer &os,
+                                    std::string const &dtypename,
+                                    DerivedType const &dtype) {
+  if (dtype.has_instance_pointer()) {
+    os.print("\n}};\n");
+    return;
+  }
   os.print(R"(
 }}
 #ifdef FORTMODGEN_EXPOSE_GLOBAL_INSTANCE
-{}
+{}{}
 #endif
 ;
 )",
-           dtypename);
+           dtypename,
+           dtype.is_instance_array() ? fmt::format("[{}]", dtype.instances)
+                                     : "");
+}
+
+// Standalone structs holding only the hot or only the cold fields of a type
+void ModuleStructsHotColdParts(OutputBuffer &os, std::string const &dtypename,
+                               DerivedType const &dtype) {
+  for (auto const &part : {"hot", "cold"}) {
+    auto part_type = dtype.get_hot_cold_part(std::string(part) == "hot");
+    if (!part_type.fields.size()) {
+      continue;
+    }
+    os.print("\nstruct {}_{}_t {{\n\n", dtypename, part);
+    ModuleStructsDerivedTypeFields(os, part_type);
+    os.print("\n}};\n");
+  }
 }
 
-void ModuleStructsFooter(fmt::ostream &os, std::string const &modname) {
+// Fortran procedures moving the hot or the cold fields of an instance
+void CHotColdAccessorDeclarations(OutputBuffer &os,
+                                  std::string const &dtypename,
+                                  DerivedType const &dtype,
+                                  std::string const &indent) {
+  for (auto const &part : {"hot", "cold"}) {
+    if (!dtype.get_hot_cold_part(std::string(part) == "hot").fields.size()) {
+      continue;
+    }
+    os.print("{0}void copy_{1}_{2}({3}void *);\n"
+             "{0}void update_{1}_{2}({3}void *);\n",
+             indent, dtypename, part, CInstanceArg(dtype, "int"));
+  }
+}
+
+void ModuleStructsFooter(OutputBuffer &os, std::string const &modname) {
   os.print("#ifdef __cplusplus\n}}\n#endif\n");
 }
 
-void CInterfaceHeader(fmt::ostream &os) {
+void CInterfaceHeader(OutputBuffer &os) {
   os.print("\n#ifndef __cplusplus\n#include <stdlib.h>\n#include <string.h>\n");
 }
 
-void CInterfaceDerivedTypeHeader(fmt::ostream &os,
-                                 std::string const &dtypename) {
+void CFieldAccessorDeclarations(OutputBuffer &os, std::string const &dtypename,
+                                DerivedType const &dtype,
+                                std::string const &indent) {
+  auto inst = CInstanceArg(dtype, "int");
+  for (auto const &fd : dtype.fields) {
+    if (!fd.is_array()) {
+      os.print("{0}{2} get_{1}_{3}({5});\n{0}void set_{1}_{3}({4}{2});\n",
+               indent, dtypename, CFieldTypes.at(fd.type), fd.name, inst,
+               CInstanceArg(dtype, "int", false));
+      continue;
+    }
+    if (!fd.is_string()) {
+      os.print("{0}void get_{1}_{3}({4}{2} *);\n"
+               "{0}void set_{1}_{3}({4}{2} const *);\n",
+               indent, dtypename, CFieldTypes.at(fd.type), fd.name, inst);
+    }
+    os.print("{0}{2} get_{1}_{3}_elem({4}int);\n"
+             "{0}void set_{1}_{3}_elem({4}int, {2});\n"
+             "{0}void get_{1}_{3}_slice({4}int, int, {2} *);\n"
+             "{0}void set_{1}_{3}_slice({4}int, int, {2} const *);\n",
+             indent, dtypename, CFieldTypes.at(fd.type), fd.name, inst);
+  }
+}
+
+void CInterfaceDerivedTypeHeader(OutputBuffer &os, std::string const &dtypename,
+                                 DerivedType const &dtype) {
   os.print(R"(
 
 //Fortran function declarations for struct interface for {0}
-void copy_{0}(void *);
-void update_{0}(void *);
-void print_{0}();
+void copy_{0}({1}void *);
+void update_{0}({1}void *);
+void print_{0}({2});
+void update_{0}_masked({1}void *, uint64_t const *);
+void touch_{0}();
+int save_{0}(char const *);
+int load_{0}(char const *);
+int write_{0}_snapshot(char const *, void const *);
+int check_{0}_layout();
+)",
+           dtypename, CInstanceArg(dtype, "int"),
+           CInstanceArg(dtype, "int", false));
+
+  if (dtype.threadprivate) {
+    os.print(R"(
+//Pointers to the calling thread's instance of {0} and its modification
+//counter
+void *instance_ptr_{0}();
+void *version_ptr_{0}();
+)",
+             dtypename);
+  } else if (dtype.is_shared()) {
+    os.print(R"(
+//Shared memory segment management for {0}, and pointers to the current
+//instance and its modification counter. The writable pointer stops with an
+//error while attached as a reader.
+int attach_{0}(char const *, int);
+void detach_{0}();
+int unlink_{0}_shm(char const *);
+void *instance_ptr_{0}();
+void *writable_instance_ptr_{0}();
+void *version_ptr_{0}();
+)",
+             dtypename);
+  } else {
+    os.print(R"(
+//Modification counter for {0}, bumped by every generated procedure that
+//modifies the Fortran instance
+extern int64_t {0}_version;
+)",
+             dtypename);
+  }
+
+  if (dtype.has_hot_fields()) {
+    os.print("\n//Fortran hot/cold part accessor declarations for {0}\n",
+             dtypename);
+    CHotColdAccessorDeclarations(os, dtypename, dtype, "");
+  }
+
+  os.print("\n//Fortran per-field accessor declarations for {0}\n", dtypename);
+  CFieldAccessorDeclarations(os, dtypename, dtype, "");
+
+  os.print(R"(
 
 //C memory management helpers for {0}
 inline struct {0}_t *alloc_{0}(){{
@@ -169,12 +494,11 @@ inline void free_{0}(struct {0}_t *inst){{
            dtypename);
 }
 
-void CInterfaceFooter(fmt::ostream &os) { os.print("\n#endif\n"); }
+void CInterfaceFooter(OutputBuffer &os) { os.print("\n#endif\n"); }
 
 void CPrintArrayRecursiveHelper(
-    fmt::ostream &os, std::string const &dtypename,
-    ParameterFields const &parameters,
-    decltype(DerivedTypes::mapped_type::fields)::value_type const &fd, int d,
+    OutputBuffer &os, std::string const &dtypename,
+    decltype(DerivedType::fields)::value_type const &fd, int d,
     std::string index_string, std::string indent) {
 
   if (d == 0) { // we actually print a row
@@ -183,18 +507,18 @@ void CPrintArrayRecursiveHelper(
 {0}for(int {1} = 0; {1} < {2}; ++{1}) {{
 {0}  printf("{6}%s",{3}_local_inst.{4}{5}, (({1}+1) == {2}) ? " " : ", " );
 {0}}})-",
-             indent, char('i' + d), fd.get_dim_size(d, parameters), dtypename,
-             fd.name, index_string, CTypePrintfSpecifier[fd.type]);
+             indent, char('i' + d), fd.get_dim_size(d), dtypename,
+             fd.name, index_string, CTypePrintfSpecifier.at(fd.type));
 
   } else {
     os.print(R"-(
 {0}for(int {1} = 0; {1} < {2}; ++{1}) {{
 {0}  printf("{0} %d: [ {3}", {1});
 )-",
-             indent, char('i' + d), fd.get_dim_size(d, parameters),
+             indent, char('i' + d), fd.get_dim_size(d),
              (d == 1) ? "" : R"(\n)");
-    CPrintArrayRecursiveHelper(os, dtypename, parameters, fd, d - 1,
-                               index_string, indent + "    ");
+    CPrintArrayRecursiveHelper(os, dtypename, fd, d - 1, index_string,
+                               indent + "    ");
 
     os.print(R"-(
 {0}  printf("{0}    ],\n");
@@ -204,10 +528,9 @@ void CPrintArrayRecursiveHelper(
   }
 }
 
-void CDerivedTypeInstancePrint(fmt::ostream &os, std::string const &dtypename,
-                               ParameterFields const &parameters,
-                               decltype(DerivedTypes::mapped_type::fields)
-                                   const &fields) {
+void CDerivedTypeInstancePrint(OutputBuffer &os, std::string const &dtypename,
+                               DerivedType const &dtype) {
+  auto const &fields = dtype.fields;
 
   os.print(R"(
 #ifndef __cplusplus
@@ -221,24 +544,25 @@ void CDerivedTypeInstancePrint(fmt::ostream &os, std::string const &dtypename,
 extern "C" {{
 #endif
 
-inline void cprint_{0}(){{
+inline void cprint_{0}({1}){{
 
 #ifndef __cplusplus
   struct {0}_t {0}_local_inst;
-  copy_{0}(&{0}_local_inst);
+  copy_{0}({2}&{0}_local_inst);
 #else
-  auto {0}_local_inst = FortMod::{0}IF::copy();
+  auto {0}_local_inst = FortMod::{0}IF::copy({3});
 #endif
   
   printf("{0}:\n");
 )",
-           dtypename);
+           dtypename, CInstanceArg(dtype, "int idx", false),
+           CInstanceArg(dtype, "idx"), CInstanceArg(dtype, "idx", false));
 
   for (auto const &fd : fields) {
 
     if (fd.is_array() && !fd.is_string()) {
       os.print(R"-(  printf("  {1} {0}{2}: {3}");)-", fd.name,
-               to_string(fd.type), fd.get_cshape_str(parameters),
+               to_string(fd.type), fd.get_cshape_str(),
                (fd.size.size() > 1) ? R"(\n)" : "");
 
       std::stringstream index_string("");
@@ -251,8 +575,8 @@ inline void cprint_{0}(){{
 )-",
                fd.size.size() > 1 ? R"(\n)" : "");
 
-      CPrintArrayRecursiveHelper(os, dtypename, parameters, fd,
-                                 fd.size.size() - 1, index_string.str(), "  ");
+      CPrintArrayRecursiveHelper(os, dtypename, fd, fd.size.size() - 1,
+                                 index_string.str(), "  ");
       os.print(R"-(
   printf("  ]\n");
 
@@ -263,7 +587,7 @@ inline void cprint_{0}(){{
 
 )-",
                dtypename, fd.name, to_string(fd.type),
-               CTypePrintfSpecifier[fd.type]);
+               CTypePrintfSpecifier.at(fd.type));
     }
   }
 
@@ -279,82 +603,1164 @@ inline void cprint_{0}(){{
            dtypename);
 }
 
-void CPPInterfaceHeader(fmt::ostream &os) {
+void CPPInterfaceHeader(OutputBuffer &os) {
   os.print(R"(
 #ifdef __cplusplus
 namespace FortMod {{
+
+#ifndef FORTMODGEN_FIELD_INFO
+#define FORTMODGEN_FIELD_INFO
+enum class field_attribute : unsigned {{
+  configurable = 1u << 0,
+  hot = 1u << 1,
+}};
+
+//Compile-time description of a member of a generated struct
+struct field_info {{
+  char const *name;
+  //element type, e.g. "double" for a double[3][5] member
+  char const *ctype;
+  size_t offset;
+  size_t size;
+  int rank;
+  //C array extents, e.g. "[3][5]", or "" for scalars
+  char const *shape;
+  unsigned attributes;
+
+  constexpr bool has(field_attribute a) const {{
+    return attributes & static_cast<unsigned>(a);
+  }}
+}};
+#endif
 )");
 }
 
-void CPPInterfaceDerivedType(fmt::ostream &os, std::string const &dtypename) {
+void CPPInterfaceDerivedTypeFieldAccessors(OutputBuffer &os,
+                                           std::string const &dtypename,
+                                           DerivedType const &dtype,
+                                           FieldDescriptor const &fd) {
+
+  // the instance index is the leading parameter of every accessor of an
+  // array of instances
+  auto idx_param = CInstanceArg(dtype, "int idx");
+  auto idx = CInstanceArg(dtype, "idx");
+
+  if (!fd.is_array()) {
+    os.print(R"(
+inline {2} get_{1}({5}){{
+  {3}
+}}
+
+inline void set_{1}({6}{2} val){{
+  {4}
+}}
+)",
+             dtypename, fd.name, CFieldTypes.at(fd.type),
+             fmt::format("return get_{}_{}({});", dtypename, fd.name,
+                         CInstanceArg(dtype, "idx", false)),
+             fmt::format("set_{}_{}({}val);", dtypename, fd.name, idx),
+             CInstanceArg(dtype, "int idx", false), idx_param);
+    return;
+  }
+
+  if (fd.is_string()) {
+    os.print(R"(
+inline std::string get_{1}({7}){{
+  char buf[{2}];
+  {4}
+  size_t first_null = 0;
+  while((first_null < {2}) && (buf[first_null] != '\0')){{
+    first_null++;
+  }}
+  return std::string(buf, first_null);
+}}
+
+inline void set_{1}({6}std::string const &in_str){{
+  if (in_str.size() > {2}) {{
+    std::cout
+        << "[WARN]: String: \"" << in_str
+        << "\", is too large to fit in {0}::{1}, truncated to {2} characters."
+        << std::endl;
+  }}
+  char buf[{3}] = {{0}};
+  std::memcpy(buf, in_str.c_str(), std::min(size_t({2}), in_str.size()));
+  {5}
+}}
+)",
+             dtypename, fd.name, fd.get_size(),
+             fd.get_storage_size(),
+             fmt::format("get_{}_{}_slice({}0, {}, buf);", dtypename,
+                         fd.name, idx, fd.get_size()),
+             fmt::format("set_{}_{}_slice({}0, {}, buf);", dtypename,
+                         fd.name, idx, fd.get_storage_size()),
+             idx_param, CInstanceArg(dtype, "int idx", false));
+  } else {
+    os.print(R"(
+inline void get_{1}({5}{2} *out){{
+  {3}
+}}
+
+inline void set_{1}({5}{2} const *in){{
+  {4}
+}}
+)",
+             dtypename, fd.name, CFieldTypes.at(fd.type),
+             fmt::format("get_{}_{}({}out);", dtypename, fd.name, idx),
+             fmt::format("set_{}_{}({}in);", dtypename, fd.name, idx),
+             idx_param);
+  }
+
+  // element accessors take indices in C order, matching the struct member
+  std::string index_args = idx_param;
+  std::string flat_index = "";
+  for (size_t i = 0; i < fd.size.size(); ++i) {
+    index_args += fmt::format("int i{}, ", i);
+    if (i == 0) {
+      flat_index = "i0";
+    } else {
+      int dim_size = fd.get_dim_size(fd.size.size() - 1 - i);
+      flat_index = fmt::format("({})*{} + i{}", flat_index, dim_size, i);
+    }
+  }
+
+  os.print(R"(
+inline {2} get_{1}_elem({3}){{
+  {5}
+}}
+
+inline void set_{1}_elem({4}{2} val){{
+  {6}
+}}
+
+inline void get_{1}_slice({9}int first, int count, {2} *out){{
+  {7}
+}}
+
+inline void set_{1}_slice({9}int first, int count, {2} const *in){{
+  {8}
+}}
+)",
+           dtypename, fd.name, CFieldTypes.at(fd.type),
+           index_args.substr(0, index_args.size() - 2), index_args,
+           fmt::format("return get_{}_{}_elem({}{});", dtypename, fd.name,
+                       idx, flat_index),
+           fmt::format("set_{}_{}_elem({}{}, val);", dtypename, fd.name, idx,
+                       flat_index),
+           fmt::format("get_{}_{}_slice({}first, count, out);", dtypename,
+                       fd.name, idx),
+           fmt::format("set_{}_{}_slice({}first, count, in);", dtypename,
+                       fd.name, idx),
+           idx_param);
+}
+
+void CPPInterfaceDerivedTypeTransaction(OutputBuffer &os,
+                                        std::string const &dtypename,
+                                        DerivedType const &dtype) {
+  auto const &fields = dtype.fields;
+
+  os.print(R"(
+//Write transaction for {0}. Fields modified through it are flagged in a
+//per-field bitmask and only those are written back to the Fortran instance
+//when the transaction is committed or destroyed. A transaction is not
+//atomic: an array field is read on first access and written back whole on
+//commit, which overwrites concurrent writes to its other elements.{5}
+class transaction {{
+  {0}_t inst;
+  uint64_t mask[{1}] = {{0}};
+{3}
+public:
+{4}  transaction(transaction const &) = delete;
+  transaction &operator=(transaction const &) = delete;
+  ~transaction(){{ commit(); }}
+
+  bool dirty() const {{
+    for(auto const &word : mask){{
+      if(word){{
+        return true;
+      }}
+    }}
+    return false;
+  }}
+
+  void commit(){{
+    if(dirty()){{
+      {2}
+      discard();
+    }}
+  }}
+
+  void discard(){{
+    std::memset(mask, 0, sizeof(mask));
+  }}
+)",
+           dtypename, (fields.size() + 63) / 64,
+           fmt::format("update_{}_masked({}&inst, mask);", dtypename,
+                       CInstanceArg(dtype, "idx")),
+           dtype.is_instance_array() ? "  int idx;\n" : "",
+           dtype.is_instance_array()
+               ? "  explicit transaction(int idx) : idx(idx) {}\n"
+               : "  transaction() = default;\n",
+           dtype.is_seqlocked()
+               ? "\n//Use modify() for an atomic read-modify-write."
+               : "");
+
+  for (size_t i = 0; i < fields.size(); ++i) {
+    auto const &fd = fields[i];
+    auto word = i / 64;
+    auto bit = fmt::format("(uint64_t(1) << {})", i % 64);
+
+    if (fd.is_string()) {
+      os.print(R"(
+  std::string get_{0}() const {{
+    return (mask[{1}] & {2}) ? inst.get_{0}() : {3}IF::get_{0}({5});
+  }}
+
+  void set_{0}(std::string const &in_str){{
+    inst.set_{0}(in_str);
+    inst.{0}[{4}] = '\0';
+    mask[{1}] |= {2};
+  }}
+)",
+               fd.name, word, bit, dtypename, fd.get_size(),
+               CInstanceArg(dtype, "idx", false));
+    } else if (fd.is_array()) {
+      std::string first_element = "";
+      for (size_t d = 0; d < fd.size.size(); ++d) {
+        first_element += "[0]";
+      }
+      // partial writes to an array need the current contents, so they are
+      // fetched from Fortran on first access
+      os.print(R"(
+  decltype({3}_t::{0}) &{0}(){{
+    if(!(mask[{1}] & {2})){{
+      {4}
+      mask[{1}] |= {2};
+    }}
+    return inst.{0};
+  }}
+)",
+               fd.name, word, bit, dtypename,
+               fmt::format("get_{}_{}({}&inst.{}{});", dtypename, fd.name,
+                           CInstanceArg(dtype, "idx"), fd.name,
+                           first_element));
+    } else {
+      os.print(R"(
+  {4} get_{0}() const {{
+    return (mask[{1}] & {2}) ? inst.{0} : {3}IF::get_{0}({5});
+  }}
+
+  void set_{0}({4} val){{
+    inst.{0} = val;
+    mask[{1}] |= {2};
+  }}
+)",
+               fd.name, word, bit, dtypename, CFieldTypes.at(fd.type),
+               CInstanceArg(dtype, "idx", false));
+    }
+  }
+
+  os.print("}};\n");
+}
+
+// The Fortran procedures of a seqlocked type take the lock themselves, the
+// C++ interface only holds it across the calls of a read-modify-write
+void CPPInterfaceSeqLock(OutputBuffer &os, std::string const &modname,
+                         std::string const &dtypename) {
+  os.print(R"(
+//Write side of the sequence lock guarding {1}, which the Fortran
+//procedures share. Writers are serialized, readers retry while one is active.
+class seqlock_writer {{
+  int64_t seq;
+
+public:
+  seqlock_writer() : seq({0}_seqlock_write_begin(&{1}_seqlock)) {{}}
+  seqlock_writer(seqlock_writer const &) = delete;
+  seqlock_writer &operator=(seqlock_writer const &) = delete;
+  ~seqlock_writer(){{
+    {0}_seqlock_write_end(&{1}_seqlock, seq);
+  }}
+}};
+)",
+           modname, dtypename);
+}
+
+std::string CPPInterfaceVersion(std::string const &dtypename,
+                                DerivedType const &dtype) {
+  if (dtype.threadprivate) {
+    return fmt::format(R"(inline int64_t version(){{
+  static thread_local int64_t const *thread_version =
+      static_cast<int64_t const *>(version_ptr_{0}());
+  return *thread_version;
+}})",
+                       dtypename);
+  }
+  if (dtype.is_shared()) { // moves when the segment is attached or detached
+    return fmt::format(R"(inline int64_t version(){{
+  return *static_cast<int64_t const *>(version_ptr_{0}());
+}})",
+                       dtypename);
+  }
+  if (dtype.is_seqlocked()) { // written by other threads under the lock
+    return fmt::format(R"(inline int64_t version(){{
+  return __atomic_load_n(&{0}_version, __ATOMIC_ACQUIRE);
+}})",
+                       dtypename);
+  }
+  return fmt::format(R"(inline int64_t version(){{
+  return {0}_version;
+}})",
+                     dtypename);
+}
+
+std::string CPPInterfaceInstance(std::string const &dtypename,
+                                 DerivedType const &dtype) {
+  if (dtype.threadprivate) {
+    return fmt::format(R"(
+//Zero-copy access to the calling thread's instance, the Fortran call that
+//looks it up is only made once per thread
+inline {0}_t &instance(){{
+  static thread_local {0}_t *thread_inst =
+      static_cast<{0}_t *>(instance_ptr_{0}());
+  return *thread_inst;
+}}
+
+inline {0}_t const &const_instance(){{
+  return instance();
+}}
+)",
+                       dtypename);
+  }
+  if (dtype.is_shared()) {
+    return fmt::format(R"(
+//Access to the current instance{1}, which lives in the shared memory segment
+//while attached. References are invalidated by attach() and detach().
+//Readers map the segment read-only, so they must use const_instance(),
+//instance() stops with an error.
+inline {0}_t &instance({2}){{
+  return static_cast<{0}_t *>(writable_instance_ptr_{0}()){3};
+}}
+
+inline {0}_t const &const_instance({2}){{
+  return static_cast<{0}_t const *>(instance_ptr_{0}()){3};
+}}
+
+//Attach to the named POSIX shared memory segment, as the single writer, which
+//creates the segment and publishes the current instance to it, or as a
+//read-only reader. Returns one of the FORTMODGEN_IO_ status codes.
+inline int attach(std::string const &name, bool writer = false){{
+  return attach_{0}(name.c_str(), writer);
+}}
+
+//Return to a process-local copy of the last contents of the segment
+inline void detach(){{
+  detach_{0}();
+}}
+
+//Remove the named segment, processes that have it attached keep using it
+//until they detach. Returns FORTMODGEN_IO_OK or FORTMODGEN_IO_OPEN_FAILED.
+inline int unlink(std::string const &name){{
+  return unlink_{0}_shm(name.c_str());
+}}
+)",
+                       dtypename, dtype.is_instance_array() ? "s" : "",
+                       CInstanceArg(dtype, "int idx", false),
+                       dtype.is_instance_array() ? "[idx]" : "[0]");
+  }
+  if (dtype.is_instance_array()) {
+    return fmt::format(R"(
+#ifdef FORTMODGEN_EXPOSE_GLOBAL_INSTANCE
+//Zero-copy access to the Fortran global instances, no Fortran call is made
+inline {0}_t &instance(int idx){{
+  return ::{0}[idx];
+}}
+
+inline {0}_t const &const_instance(int idx){{
+  return ::{0}[idx];
+}}
+#endif
+)",
+                       dtypename);
+  }
+  return fmt::format(R"(
+#ifdef FORTMODGEN_EXPOSE_GLOBAL_INSTANCE
+//Zero-copy access to the Fortran global instance, no Fortran call is made
+inline {0}_t &instance(){{
+  return ::{0};
+}}
+
+inline {0}_t const &const_instance(){{
+  return ::{0};
+}}
+#endif
+)",
+                     dtypename);
+}
+
+void CPPInterfaceHotColdParts(OutputBuffer &os, std::string const &dtypename,
+                              DerivedType const &dtype) {
+  for (auto const &part : {"hot", "cold"}) {
+    if (!dtype.get_hot_cold_part(std::string(part) == "hot").fields.size()) {
+      continue;
+    }
+    os.print(R"(
+//Copy only the {1} fields of {0}
+inline {0}_{1}_t copy_{1}({2}){{
+  {0}_{1}_t inst;
+  {4}
+  return inst;
+}}
+
+inline void update_{1}({3}{0}_{1}_t inst){{
+  {5}
+}}
+)",
+             dtypename, part, CInstanceArg(dtype, "int idx", false),
+             CInstanceArg(dtype, "int idx"),
+             fmt::format("copy_{}_{}({}&inst);", dtypename, part,
+                         CInstanceArg(dtype, "idx")),
+             fmt::format("update_{}_{}({}&inst);", dtypename, part,
+                         CInstanceArg(dtype, "idx")));
+  }
+}
+
+// constexpr field table for a type and a visitor over the members of an
+// instance, which the compiler can unroll into direct member accesses
+void CPPInterfaceReflection(OutputBuffer &os, std::string const &dtypename,
+                            DerivedType const &dtype) {
+  std::string entries = "", visits = "";
+  for (size_t i = 0; i < dtype.fields.size(); ++i) {
+    auto const &fd = dtype.fields[i];
+    std::string shape = fd.get_cshape_str();
+    if (fd.is_string()) {
+      shape = fmt::format("[{}]", fd.get_size() + 1);
+    }
+    std::vector<std::string> attributes;
+    for (auto a : {AttributeType::kConfigurable, AttributeType::kHot}) {
+      if (fd.attributes.count(a)) {
+        attributes.push_back(
+            fmt::format("unsigned(field_attribute::{})", to_string(a)));
+      }
+    }
+    if (!attributes.size()) {
+      attributes.push_back("0");
+    }
+    std::string attribute_mask = attributes[0];
+    for (size_t j = 1; j < attributes.size(); ++j) {
+      attribute_mask += " | " + attributes[j];
+    }
+
+    entries += fmt::format(
+        "\n  {{\"{1}\", \"{2}\", offsetof({0}_t, {1}), sizeof({0}_t::{1}), "
+        "{3}, \"{4}\", {5}}}{6}",
+        dtypename, fd.name, CPPFieldType(fd), fd.size.size(), shape,
+        attribute_mask, ((i + 1) == dtype.fields.size()) ? "" : ",");
+    visits += fmt::format("\n  f(fields[{}], inst.{});", i, fd.name);
+  }
+
+  os.print(R"(
+//Members of {0}_t in declaration order, explicit padding is not listed
+constexpr int nfields = {1};
+constexpr field_info fields[nfields] = {{{2}
+}};
+
+//Calls f(fields[i], member) for every member of inst in declaration order
+template <typename F>
+constexpr void for_each_field({0}_t &inst, F &&f){{{3}
+}}
+
+template <typename F>
+constexpr void for_each_field({0}_t const &inst, F &&f){{{3}
+}}
+)",
+           dtypename, dtype.fields.size(), entries, visits);
+}
+
+void CPPInterfaceDerivedType(OutputBuffer &os, std::string const &modname,
+                             std::string const &dtypename,
+                             DerivedType const &dtype) {
   os.print(R"(
 //C++ Interface for {0}
 
 extern "C" {{
   //Fortran function declarations for struct interface for {0}
-  void copy_{0}(void *);
-  void update_{0}(void *);
-  void print_{0}();
-}}
+  void copy_{0}({1}void *);
+  void update_{0}({1}void *);
+  void print_{0}({2});
+  void update_{0}_masked({1}void *, uint64_t const *);
+  void touch_{0}();
+  int save_{0}(char const *);
+  int load_{0}(char const *);
+  int write_{0}_snapshot(char const *, void const *);
+  int check_{0}_layout();
+)",
+           dtypename, CInstanceArg(dtype, "int"),
+           CInstanceArg(dtype, "int", false));
 
-namespace {0}IF {{
+  if (dtype.threadprivate) {
+    os.print(R"(
+  //Pointers to the calling thread's instance of {0} and its modification
+  //counter
+  void *instance_ptr_{0}();
+  void *version_ptr_{0}();
+)",
+             dtypename);
+  } else if (dtype.is_shared()) {
+    os.print(R"(
+  //Shared memory segment management for {0}, and pointers to the current
+  //instance and its modification counter. The writable pointer stops with an
+  //error while attached as a reader.
+  int attach_{0}(char const *, int);
+  void detach_{0}();
+  int unlink_{0}_shm(char const *);
+  void *instance_ptr_{0}();
+  void *writable_instance_ptr_{0}();
+  void *version_ptr_{0}();
+)",
+             dtypename);
+  } else {
+    os.print(R"(
+  //Modification counter for {0}
+  extern int64_t {0}_version;
+)",
+             dtypename);
+  }
 
-inline {0}_t copy(){{
+  if (dtype.is_seqlocked()) {
+    os.print(R"(
+  //Sequence lock of {1} and the helpers of the module's C support file
+  //that take it, the instance is only accessed directly under the lock
+  extern int64_t {1}_seqlock;
+  int64_t {0}_seqlock_write_begin(int64_t *);
+  void {0}_seqlock_write_end(int64_t *, int64_t);
+  void *instance_ptr_{1}();
+)",
+             modname, dtypename);
+  }
+
+  if (dtype.has_hot_fields()) {
+    os.print("\n  //Fortran hot/cold part accessor declarations for {0}\n",
+             dtypename);
+    CHotColdAccessorDeclarations(os, dtypename, dtype, "  ");
+  }
+
+  os.print("\n  //Fortran per-field accessor declarations for {0}\n",
+           dtypename);
+  CFieldAccessorDeclarations(os, dtypename, dtype, "  ");
+
+  os.print("}}\n\nnamespace {0}IF {{\n", dtypename);
+
+  if (dtype.is_seqlocked()) {
+    CPPInterfaceSeqLock(os, modname, dtypename);
+  }
+
+  os.print(R"(
+inline {0}_t copy({5}){{
   {0}_t inst;
-  copy_{0}(&inst);
+  {1}
   return inst;
 }}
 
-inline void update({0}_t inst){{
-  update_{0}(&inst);
+inline void update({6}{0}_t inst){{
+  {2}
 }}
 
+{3}
+
+//Flag the instance as modified after writing to it directly
+inline void touch(){{
+  touch_{0}();
 }}
 
+//Raw binary snapshots of {9}, returning one of the FORTMODGEN_IO_
+//status codes. Loading refuses files written for a different layout.
+constexpr int64_t layout_hash = {10};
+
+inline int save(std::string const &path){{
+  return save_{0}(path.c_str());
+}}
+
+inline int load(std::string const &path){{
+  int status;
+  {11}
+  return status;
+}}
+
+//Snapshot of {0} that is only copied again from Fortran when the
+//modification counter has moved since the last copy
+class cached {{
+  {0}_t inst{{}};
+  int64_t inst_version = -1;
+{7}
+public:
+{8}  bool stale() const {{
+    return inst_version != version();
+  }}
+
+  {0}_t const &get(){{
+    if(stale()){{
+      // read the counter first so that a concurrent modification is
+      // picked up by the next call
+      inst_version = version();
+      {1}
+    }}
+    return inst;
+  }}
+}};
+{4})",
+           dtypename,
+           fmt::format("copy_{}({}&inst);", dtypename,
+                       CInstanceArg(dtype, "idx")),
+           fmt::format("update_{}({}&inst);", dtypename,
+                       CInstanceArg(dtype, "idx")),
+           CPPInterfaceVersion(dtypename, dtype),
+           CPPInterfaceInstance(dtypename, dtype),
+           CInstanceArg(dtype, "int idx", false), CInstanceArg(dtype, "int idx"),
+           dtype.is_instance_array() ? "  int idx;\n" : "",
+           dtype.is_instance_array()
+               ? "  explicit cached(int idx) : idx(idx) {}\n\n"
+               : "",
+           dtype.is_instance_array() ? "all instances" : "the instance",
+           GetLayoutHash(dtypename, dtype),
+           fmt::format("status = load_{}(path.c_str());", dtypename));
+
+  if (dtype.is_seqlocked()) {
+    os.print(R"(
+//Read-modify-write of the whole instance under a single write lock, so that
+//no concurrent write, from C++ or Fortran, is lost between the read and the
+//write, unlike with a transaction. f works on a copy, which is discarded if
+//it throws.
+template <typename F> inline void modify({1}F const &f){{
+  seqlock_writer lock;
+  {0}_t &global = static_cast<{0}_t *>(instance_ptr_{0}()){2};
+  {0}_t inst = global;
+  f(inst);
+  global = inst;
+  __atomic_store_n(&{0}_version, {0}_version + 1, __ATOMIC_RELEASE);
+}}
 )",
-           dtypename);
+             dtypename, CInstanceArg(dtype, "int idx"),
+             dtype.is_instance_array() ? "[idx]" : "[0]");
+  }
+
+  if (dtype.has_hot_fields()) {
+    CPPInterfaceHotColdParts(os, dtypename, dtype);
+  }
+
+  CPPInterfaceReflection(os, dtypename, dtype);
+
+  for (auto const &fd : dtype.fields) {
+    CPPInterfaceDerivedTypeFieldAccessors(os, dtypename, dtype, fd);
+  }
+
+  CPPInterfaceDerivedTypeTransaction(os, dtypename, dtype);
+
+  os.print("\n}}\n\n");
 }
 
-void CPPInterfaceFooter(fmt::ostream &os) { os.print("}}\n#endif\n"); }
+void CPPInterfaceFooter(OutputBuffer &os) { os.print("}}\n#endif\n"); }
 
-void GenerateCInterface(std::string const &fname, std::string const &modname,
-                        ParameterFields const &parameters,
-                        DerivedTypes const &dtypes,
-                        std::vector<std::string> const &Uses) {
+// Parsing helpers shared by the configuration loaders of all modules
+void CPPConfigHelpers(OutputBuffer &os) {
+  os.print(R"(
+#ifndef FORTMODGEN_CONFIG_HELPERS
+#define FORTMODGEN_CONFIG_HELPERS
+#include <cstdlib>
+#include <fstream>
 
-  auto out = fmt::output_file(fname);
+namespace FortMod {{
+namespace detail {{
 
-  ModuleStructsHeader(out, modname);
+inline uint64_t fnv1a(std::string const &str, uint64_t seed){{
+  uint64_t hash = 14695981039346656037ULL ^ seed;
+  for(unsigned char c : str){{
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }}
+  return hash;
+}}
 
-  ModuleStructsParameters(out, parameters);
+inline std::string trim(std::string const &str){{
+  size_t first = str.find_first_not_of(" \t\r");
+  if(first == std::string::npos){{
+    return "";
+  }}
+  return str.substr(first, str.find_last_not_of(" \t\r") - first + 1);
+}}
 
-  for (auto const &dt : dtypes) {
+inline std::string strip_comment(std::string const &line){{
+  char quote = '\0';
+  for(size_t i = 0; i < line.size(); ++i){{
+    if(quote){{
+      quote = (line[i] == quote) ? '\0' : quote;
+    }} else if((line[i] == '"') || (line[i] == '\'')){{
+      quote = line[i];
+    }} else if(line[i] == '#'){{
+      return line.substr(0, i);
+    }}
+  }}
+  return line;
+}}
+
+inline bool parse_value(std::string const &str, int &val){{
+  char *end;
+  val = int(std::strtol(str.c_str(), &end, 10));
+  return str.size() && (*end == '\0');
+}}
+
+inline bool parse_value(std::string const &str, float &val){{
+  char *end;
+  val = std::strtof(str.c_str(), &end);
+  return str.size() && (*end == '\0');
+}}
+
+inline bool parse_value(std::string const &str, double &val){{
+  char *end;
+  val = std::strtod(str.c_str(), &end);
+  return str.size() && (*end == '\0');
+}}
+
+inline bool parse_value(std::string const &str, bool &val){{
+  val = (str == "true");
+  return val || (str == "false");
+}}
+
+inline bool parse_value(std::string const &str, std::string &val){{
+  if((str.size() > 1) && ((str.front() == '"') || (str.front() == '\'')) &&
+     (str.back() == str.front())){{
+    val = str.substr(1, str.size() - 2);
+  }} else {{
+    val = str;
+  }}
+  return true;
+}}
+
+inline bool parse_value(std::string const &str, char &val){{
+  std::string unquoted;
+  parse_value(str, unquoted);
+  val = unquoted.size() ? unquoted.front() : ' ';
+  return unquoted.size() < 2;
+}}
 
-    ModuleStructsDerivedTypeHeader(out, dt.first, dt.second.comment);
+//Nested arrays are flattened, so the elements are given in the memory order
+//of the field
+template <typename T>
+inline bool parse_array(std::string const &str, T *out, int n){{
+  std::string flat;
+  for(char c : str){{
+    if((c != '[') && (c != ']')){{
+      flat += c;
+    }}
+  }}
+  int count = 0;
+  size_t start = 0;
+  while(start <= flat.size()){{
+    size_t end = flat.find(',', start);
+    end = (end == std::string::npos) ? flat.size() : end;
+    std::string element = trim(flat.substr(start, end - start));
+    start = end + 1;
+    if(element.empty() && (start > flat.size())){{ // trailing comma
+      break;
+    }}
+    if((count == n) || !parse_value(element, out[count])){{
+      return false;
+    }}
+    count++;
+  }}
+  return count == n;
+}}
+
+}}
+}}
+#endif
+)");
+}
 
+// Runtime loader for the fields with the configurable attribute. Names of the
+// form type.field are looked up through a hash-and-displace perfect hash built
+// here, so a lookup costs two hashes of the name and one string comparison.
+void CPPInterfaceConfigLoader(OutputBuffer &os, std::string const &modname,
+                              DerivedTypes const &dtypes) {
+  struct ConfigurableField {
+    std::string key;
+    std::string dtypename;
+    DerivedType const *dtype;
+    FieldDescriptor const *fd;
+  };
+  std::vector<ConfigurableField> cfields;
+  for (auto const &dt : dtypes) {
     for (auto const &fd : dt.second.fields) {
+      if (fd.attributes.count(AttributeType::kConfigurable)) {
+        cfields.push_back({dt.first + "." + fd.name, dt.first, &dt.second, &fd});
+      }
+    }
+  }
+  if (!cfields.size()) {
+    return;
+  }
+  // keys that are equal can never be given different slots
+  for (size_t i = 0; i < cfields.size(); ++i) {
+    for (size_t j = 0; j < i; ++j) {
+      if (cfields[i].key == cfields[j].key) {
+        Error("Configurable field \"", cfields[i].key,
+              "\" is declared more than once.");
+      }
+    }
+  }
 
-      ModuleStructsDerivedTypeField(out, dt.first, fd, parameters);
+  size_t nbuckets = 1;
+  while ((nbuckets * 4) < cfields.size()) {
+    nbuckets <<= 1;
+  }
+
+  std::vector<std::vector<size_t>> buckets(nbuckets);
+  for (size_t i = 0; i < cfields.size(); ++i) {
+    buckets[fnv1a(cfields[i].key) & (nbuckets - 1)].push_back(i);
+  }
+  std::vector<size_t> bucket_order(nbuckets);
+  for (size_t b = 0; b < nbuckets; ++b) {
+    bucket_order[b] = b;
+  }
+  std::stable_sort(bucket_order.begin(), bucket_order.end(),
+                   [&](size_t a, size_t b) {
+                     return buckets[a].size() > buckets[b].size();
+                   });
+
+  // the largest buckets are placed first, while most slots are still free.
+  // Each bucket tries a bounded number of seeds, if one runs out the table
+  // is doubled and every bucket is placed again.
+  uint64_t const kMaxSeed = 1 << 16;
+  size_t table_size = 1;
+  while (table_size < cfields.size()) {
+    table_size <<= 1;
+  }
+  std::vector<uint64_t> seeds;
+  std::vector<int> slot_field;
+  auto place_buckets = [&]() {
+    seeds.assign(nbuckets, 0);
+    slot_field.assign(table_size, -1);
+    for (auto b : bucket_order) {
+      if (!buckets[b].size()) {
+        continue;
+      }
+      for (uint64_t seed = 1;; ++seed) {
+        if (seed > kMaxSeed) {
+          return false;
+        }
+        std::vector<size_t> slots;
+        for (auto i : buckets[b]) {
+          size_t slot = fnv1a(cfields[i].key, seed) & (table_size - 1);
+          if ((slot_field[slot] != -1) ||
+              (std::find(slots.begin(), slots.end(), slot) != slots.end())) {
+            break;
+          }
+          slots.push_back(slot);
+        }
+        if (slots.size() == buckets[b].size()) {
+          for (size_t j = 0; j < slots.size(); ++j) {
+            slot_field[slots[j]] = buckets[b][j];
+          }
+          seeds[b] = seed;
+          break;
+        }
+      }
     }
+    return true;
+  };
+  while (!place_buckets()) {
+    table_size <<= 1;
+  }
 
-    ModuleStructsDerivedTypeFooter(out, dt.first);
+  std::string seed_list = "", name_list = "";
+  for (size_t b = 0; b < nbuckets; ++b) {
+    seed_list += fmt::format("{}{}", seeds[b], ((b + 1) == nbuckets) ? "" : ", ");
+  }
+  for (size_t slot = 0; slot < table_size; ++slot) {
+    name_list += fmt::format(
+        "\n    {}{}",
+        (slot_field[slot] == -1)
+            ? "nullptr"
+            : fmt::format("\"{}\"", cfields[slot_field[slot]].key),
+        ((slot + 1) == table_size) ? "" : ",");
   }
 
-  ModuleStructsFooter(out, modname);
+  os.print(R"(
+#ifdef __cplusplus
+namespace FortMod {{
+namespace {0}Config {{
+
+//Slot of a configurable field name, or -1 if there is no such field
+inline int field_index(std::string const &name){{
+  static uint64_t const seeds[{1}] = {{{2}}};
+  static char const *const names[{3}] = {{{4}
+  }};
+  size_t slot = detail::fnv1a(name, seeds[detail::fnv1a(name, 0) & {5}]) & {6};
+  return (names[slot] && (name == names[slot])) ? int(slot) : -1;
+}}
 
-  CInterfaceHeader(out);
-  for (auto const &dt : dtypes) {
-    CInterfaceDerivedTypeHeader(out, dt.first);
+//Assign a configurable field, named as type.field, from the text of a TOML
+//value. Returns false for unknown names and unparsable values.
+inline bool set_by_name(std::string const &name, std::string const &value){{
+  switch(field_index(name)){{
+)",
+           modname, nbuckets, seed_list, table_size, name_list, nbuckets - 1,
+           table_size - 1);
+
+  for (size_t slot = 0; slot < table_size; ++slot) {
+    if (slot_field[slot] == -1) {
+      continue;
+    }
+    auto const &cf = cfields[slot_field[slot]];
+    auto const &fd = *cf.fd;
+    auto ctype = CPPFieldType(fd);
+
+    std::string parse, setter;
+    if (fd.is_string()) {
+      parse = "std::string val;\n    if(!detail::parse_value(value, val))";
+      setter = fmt::format("{}IF::set_{}({}val);", cf.dtypename, fd.name,
+                           CInstanceArg(*cf.dtype, "idx"));
+    } else if (fd.is_array()) {
+      parse = fmt::format(
+          "{} val[{}];\n    if(!detail::parse_array(value, val, {}))", ctype,
+          fd.get_size(), fd.get_size());
+      setter = fmt::format("{}IF::set_{}_slice({}0, {}, val);", cf.dtypename,
+                           fd.name, CInstanceArg(*cf.dtype, "idx"),
+                           fd.get_size());
+    } else {
+      parse = fmt::format("{} val;\n    if(!detail::parse_value(value, val))",
+                          ctype);
+      setter = fmt::format("{}IF::set_{}({}val);", cf.dtypename, fd.name,
+                           CInstanceArg(*cf.dtype, "idx"));
+    }
+    // instance arrays get the value assigned to every instance
+    if (cf.dtype->is_instance_array()) {
+      setter = fmt::format("for(int idx = 0; idx < {}; ++idx){{\n      {}\n    }}",
+                           cf.dtype->instances, setter);
+    }
+
+    os.print(R"(
+  case {0}: {{ // {1}
+    {2}{{
+      return false;
+    }}
+    {3}
+    return true;
+  }}
+)",
+             slot, cf.key, parse, setter);
   }
-  CInterfaceFooter(out);
 
-  CPPInterfaceHeader(out);
+  os.print(R"(
+  default: {{
+    return false;
+  }}
+  }}
+}}
+
+//Apply a command-line style override, type.field=value
+inline bool set_override(std::string const &assignment){{
+  size_t eq = assignment.find('=');
+  if(eq == std::string::npos){{
+    return false;
+  }}
+  return set_by_name(detail::trim(assignment.substr(0, eq)),
+                     detail::trim(assignment.substr(eq + 1)));
+}}
+
+//Assign the configurable fields listed in a file using a subset of TOML:
+//single line key = value pairs, where keys are type.field or field under a
+//[type] table header, and # comments. Returns one of the FORTMODGEN_IO_
+//status codes, after trying every line.
+inline int load_config(std::string const &path){{
+  std::ifstream file(path);
+  if(!file){{
+    return FORTMODGEN_IO_OPEN_FAILED;
+  }}
+
+  int status = FORTMODGEN_IO_OK;
+  std::string line, table;
+  for(int lineno = 1; std::getline(file, line); ++lineno){{
+    line = detail::trim(detail::strip_comment(line));
+    if(line.empty()){{
+      continue;
+    }}
+    size_t eq = line.find('=');
+    bool ok = false;
+    if((line.front() == '[') && (line.back() == ']')){{
+      table = detail::trim(line.substr(1, line.size() - 2));
+      ok = true;
+    }} else if(eq != std::string::npos){{
+      std::string key = detail::trim(line.substr(0, eq));
+      ok = set_by_name(table.empty() ? key : (table + "." + key),
+                       detail::trim(line.substr(eq + 1)));
+    }}
+    if(!ok){{
+      std::cout << "[ERROR]: " << path << ":" << lineno
+                << ": cannot assign a configurable field from: " << line
+                << std::endl;
+      status = FORTMODGEN_IO_ERROR;
+    }}
+  }}
+  return status;
+}}
+
+}}
+}}
+#endif
+)");
+}
+
+std::vector<std::string> CInterfaceFiles(std::string const &outstub) {
+  return {outstub + "_structs.h", outstub + "_c.h",     outstub + "_strings.h",
+          outstub + "_cpp.h",     outstub + "_print.h", outstub + ".h"};
+}
+
+std::vector<std::pair<std::string, bool>>
+GenerateCInterface(std::string const &outstub, std::string const &modname,
+                   ParameterFields const &parameters, DerivedTypes const &dtypes,
+                   std::vector<std::string> const &Uses,
+                   int nthreads) {
+
+  // included files are named relative to the including header
+  std::string base = outstub.substr(outstub.find_last_of('/') + 1);
+
+  // every type is rendered on its own into each part, which are then joined
+  // in declaration order
+  size_t ntypes = dtypes.size();
+  std::vector<OutputBuffer> type_structs(ntypes), type_cdecls(ntypes),
+      type_strings(ntypes), type_cpp(ntypes), type_print(ntypes);
+  ParallelFor(ntypes, nthreads, [&](size_t i) {
+    auto const &dt = dtypes[i];
+
+    ModuleStructsDerivedTypeHeader(type_structs[i], dt.first, dt.second);
+
+    ModuleStructsDerivedTypeFields(type_structs[i], dt.second);
+
+    ModuleStructsDerivedTypeFooter(type_structs[i], dt.first, dt.second);
+
+    ModuleStructsLayoutChecks(type_structs[i], dt.first, dt.second);
+
+    if (dt.second.has_hot_fields()) {
+      ModuleStructsHotColdParts(type_structs[i], dt.first, dt.second);
+    }
+
+    CInterfaceDerivedTypeHeader(type_cdecls[i], dt.first, dt.second);
+
+    ModuleStructsStringHelpers(type_strings[i], dt.first, dt.second);
+    if (dt.second.has_hot_fields()) {
+      for (bool hot : {true, false}) {
+        ModuleStructsStringHelpers(type_strings[i],
+                                   dt.first + (hot ? "_hot" : "_cold"),
+                                   dt.second.get_hot_cold_part(hot));
+      }
+    }
+
+    CPPInterfaceDerivedType(type_cpp[i], modname, dt.first, dt.second);
+
+    CDerivedTypeInstancePrint(type_print[i], dt.first, dt.second);
+  });
+
+  OutputBuffer structs;
+
+  ModuleStructsHeader(structs, modname);
+
+  ModuleStructsParameters(structs, parameters);
+
+  structs.append(type_structs);
+
+  ModuleStructsFooter(structs, modname);
+
+  OutputBuffer cdecls;
+  GeneratedHeaderPreamble(cdecls);
+  cdecls.print("\n#include \"{}_structs.h\"\n", base);
+  CInterfaceHeader(cdecls);
+  cdecls.append(type_cdecls);
+  CInterfaceFooter(cdecls);
+
+  OutputBuffer strings;
+  GeneratedHeaderPreamble(strings);
+  strings.print(R"(
+#include "{}_structs.h"
+
+#ifdef __cplusplus
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+)",
+                base);
+  strings.append(type_strings);
+  strings.print("\n#endif\n");
+
+  OutputBuffer cpp;
+  GeneratedHeaderPreamble(cpp);
+  cpp.print(R"(
+#include "{0}_structs.h"
+#include "{0}_strings.h"
+
+#ifdef __cplusplus
+#include <cstring>
+#include <iostream>
+#include <string>
+#endif
+)",
+            base);
+  CPPInterfaceHeader(cpp);
+  cpp.append(type_cpp);
+  CPPInterfaceFooter(cpp);
+
+  bool has_configurable_fields = false;
   for (auto const &dt : dtypes) {
-    CPPInterfaceDerivedType(out, dt.first);
+    for (auto const &fd : dt.second.fields) {
+      has_configurable_fields |=
+          bool(fd.attributes.count(AttributeType::kConfigurable));
+    }
+  }
+  if (has_configurable_fields) {
+    cpp.print("\n#ifdef __cplusplus\n");
+    CPPConfigHelpers(cpp);
+    cpp.print("#endif\n");
+    CPPInterfaceConfigLoader(cpp, modname, dtypes);
   }
-  CPPInterfaceFooter(out);
 
-  for (auto const &dt : dtypes) {
-    CDerivedTypeInstancePrint(out, dt.first, parameters, dt.second.fields);
+  OutputBuffer print;
+  GeneratedHeaderPreamble(print);
+  print.print(R"(
+#ifdef __cplusplus
+#include "{0}_cpp.h"
+#else
+#include "{0}_c.h"
+#endif
+)",
+              base);
+  print.append(type_print);
+
+  OutputBuffer umbrella;
+  GeneratedHeaderPreamble(umbrella);
+  umbrella.print(R"(
+//The complete interface to module {0}. Each part can also be included on
+//its own, so that translation units only parse what they use:
+//  {1}_structs.h  parameters and struct definitions, for C and C++
+//  {1}_c.h        C declarations of the Fortran procedures
+//  {1}_strings.h  definitions of the C++ string member helpers
+//  {1}_cpp.h      the C++ interface in namespace FortMod
+//  {1}_print.h    the cprint_ routines
+#include "{1}_structs.h"
+#include "{1}_c.h"
+#include "{1}_strings.h"
+#include "{1}_cpp.h"
+#include "{1}_print.h"
+)",
+                 modname, base);
+
+  // in the order of CInterfaceFiles
+  std::vector<OutputBuffer *> parts{&structs, &cdecls, &strings,
+                                    &cpp,     &print,  &umbrella};
+  auto fnames = CInterfaceFiles(outstub);
+
+  std::vector<std::pair<std::string, bool>> written;
+  for (size_t i = 0; i < parts.size(); ++i) {
+    parts[i]->StampContentHash();
+    written.emplace_back(fnames[i], parts[i]->WriteIfChanged(fnames[i]));
   }
-}
\ No newline at end of file
+  return written;
+}
@@ -4,7 +4,15 @@
 
 #include <string>
 
-void GenerateCInterface(std::string const &fname, std::string const &modname,
-                        ParameterFields const &parameters,
-                        DerivedTypes const &dtypes,
-                        std::vector<std::string> const &Uses);
\ No newline at end of file
+// The files GenerateCInterface writes for outstub
+std::vector<std::string> CInterfaceFiles(std::string const &outstub);
+
+// Writes <outstub>.h, which includes the separately usable parts
+// <outstub>_structs.h, _c.h, _strings.h, _cpp.h and _print.h. The types are
+// rendered on up to nthreads threads. Returns each file name with whether it
+// was written, unchanged files are left untouched.
+std::vector<std::pair<std::string, bool>>
+GenerateCInterface(std::string const &outstub, std::string const &modname,
+                   ParameterFields const &parameters, DerivedTypes const &dtypes,
+                   std::vector<std::string> const &Uses,
+                   int nthreads = 1);
\ No newline at end of file
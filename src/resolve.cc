@@ -0,0 +1,453 @@
+#include "resolve.h"
+
+#include "fmt/core.h"
+
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+ConstantValue ConstantValue::convert(FieldType ft) const {
+  ConstantValue out;
+  out.type = ft;
+  if (ft == FieldType::kInteger) {
+    // real to integer conversion truncates towards zero
+    out.i = is_integer() ? i : int64_t(std::trunc(d));
+  } else if (ft == FieldType::kFloat) {
+    out.d = float(as_double());
+  } else {
+    out.d = as_double();
+  }
+  return out;
+}
+
+std::string ConstantValue::literal() const {
+  switch (type) {
+  case FieldType::kInteger: {
+    return std::to_string(i);
+  }
+  case FieldType::kFloat: { // 9 significant digits round trip a float
+    return fmt::format("{:.8E}", d);
+  }
+  default: { // and 17 a double
+    return fmt::format("{:.16E}", d);
+  }
+  }
+}
+
+namespace {
+
+// Recursive descent over the Fortran constant expression grammar:
+//   expr    := [sign] term { (+|-) term }
+//   term    := power { (*|/) power }
+//   power   := primary [ ** power ]
+//   primary := literal | name | ( expr )
+class ExpressionParser {
+  std::string const &expr;
+  SymbolTable const &symbols;
+  size_t pos = 0;
+
+public:
+  std::string error;
+
+  ExpressionParser(std::string const &expr, SymbolTable const &symbols)
+      : expr(expr), symbols(symbols) {}
+
+  bool parse(ConstantValue &value) {
+    if (!parse_expr(value)) {
+      return false;
+    }
+    skip_space();
+    if (pos != expr.size()) {
+      return fail(fmt::format("unexpected \"{}\"", expr.substr(pos)));
+    }
+    return true;
+  }
+
+private:
+  bool fail(std::string const &message) {
+    if (error.empty()) {
+      error = message;
+    }
+    return false;
+  }
+
+  void skip_space() {
+    while ((pos < expr.size()) && std::isspace((unsigned char)expr[pos])) {
+      pos++;
+    }
+  }
+
+  bool accept(char const *token) {
+    skip_space();
+    size_t len = std::char_traits<char>::length(token);
+    if (expr.compare(pos, len, token)) {
+      return false;
+    }
+    // a * must not match the first half of **
+    if ((len == 1) && (token[0] == '*') && (expr.compare(pos, 2, "**") == 0)) {
+      return false;
+    }
+    pos += len;
+    return true;
+  }
+
+  // result kind of a binary operation on a and b, as in Fortran
+  static FieldType promote(ConstantValue const &a, ConstantValue const &b) {
+    if ((a.type == FieldType::kDouble) || (b.type == FieldType::kDouble)) {
+      return FieldType::kDouble;
+    }
+    if ((a.type == FieldType::kFloat) || (b.type == FieldType::kFloat)) {
+      return FieldType::kFloat;
+    }
+    return FieldType::kInteger;
+  }
+
+  bool check_range(ConstantValue &v) {
+    if (v.is_integer()) {
+      if ((v.i < std::numeric_limits<int32_t>::min()) ||
+          (v.i > std::numeric_limits<int32_t>::max())) {
+        return fail("integer overflow");
+      }
+    } else {
+      if (v.type == FieldType::kFloat) {
+        v.d = float(v.d);
+      }
+      if (!std::isfinite(v.d)) {
+        return fail("result is not finite");
+      }
+    }
+    return true;
+  }
+
+  bool apply(char op, ConstantValue &a, ConstantValue const &b) {
+    FieldType type = promote(a, b);
+    if (type == FieldType::kInteger) {
+      switch (op) {
+      case '+': {
+        a.i += b.i;
+        break;
+      }
+      case '-': {
+        a.i -= b.i;
+        break;
+      }
+      case '*': {
+        a.i *= b.i;
+        break;
+      }
+      case '/': {
+        if (!b.i) {
+          return fail("division by zero");
+        }
+        a.i /= b.i;
+        break;
+      }
+      }
+      return check_range(a);
+    }
+
+    ConstantValue lhs = a.convert(type), rhs = b.convert(type);
+    switch (op) {
+    case '+': {
+      lhs.d += rhs.d;
+      break;
+    }
+    case '-': {
+      lhs.d -= rhs.d;
+      break;
+    }
+    case '*': {
+      lhs.d *= rhs.d;
+      break;
+    }
+    case '/': {
+      if (rhs.d == 0) {
+        return fail("division by zero");
+      }
+      lhs.d /= rhs.d;
+      break;
+    }
+    }
+    a = lhs;
+    return check_range(a);
+  }
+
+  bool parse_expr(ConstantValue &value) {
+    bool negate = false;
+    if (accept("-")) {
+      negate = true;
+    } else {
+      accept("+");
+    }
+    if (!parse_term(value)) {
+      return false;
+    }
+    if (negate) {
+      ConstantValue zero = ConstantValue().convert(value.type);
+      if (!apply('-', zero, value)) {
+        return false;
+      }
+      value = zero;
+    }
+    while (true) {
+      char op = accept("+") ? '+' : (accept("-") ? '-' : 0);
+      if (!op) {
+        return true;
+      }
+      ConstantValue rhs;
+      if (!parse_term(rhs) || !apply(op, value, rhs)) {
+        return false;
+      }
+    }
+  }
+
+  bool parse_term(ConstantValue &value) {
+    if (!parse_power(value)) {
+      return false;
+    }
+    while (true) {
+      char op = accept("*") ? '*' : (accept("/") ? '/' : 0);
+      if (!op) {
+        return true;
+      }
+      ConstantValue rhs;
+      if (!parse_power(rhs) || !apply(op, value, rhs)) {
+        return false;
+      }
+    }
+  }
+
+  // ** is right associative
+  bool parse_power(ConstantValue &value) {
+    if (!parse_primary(value)) {
+      return false;
+    }
+    if (!accept("**")) {
+      return true;
+    }
+    ConstantValue exponent;
+    if (!parse_power(exponent)) {
+      return false;
+    }
+    if (exponent.is_integer()) {
+      if (value.is_integer()) {
+        // integer powers with negative exponents are 1/(base**-n), truncated
+        int64_t result = 1;
+        if (exponent.i < 0) {
+          if (!value.i) {
+            return fail("division by zero");
+          }
+          result = ((value.i == 1) || (value.i == -1))
+                       ? ((exponent.i % 2) ? value.i : 1)
+                       : 0;
+        } else if ((value.i == 0) || (value.i == 1) || (value.i == -1)) {
+          // powers of these stay in range for any exponent, every other base
+          // overflows within 31 multiplications
+          result = (value.i == 0) ? (exponent.i ? 0 : 1)
+                                  : ((exponent.i % 2) ? value.i : 1);
+        } else {
+          for (int64_t k = 0; k < exponent.i; ++k) {
+            result *= value.i;
+            if (std::abs(result) > std::numeric_limits<int32_t>::max()) {
+              return fail("integer overflow");
+            }
+          }
+        }
+        value.i = result;
+        return check_range(value);
+      }
+      value.d = std::pow(value.d, double(exponent.i));
+      return check_range(value);
+    }
+    FieldType type = promote(value, exponent);
+    value = value.convert(type);
+    if (value.d < 0) {
+      return fail("negative base raised to a real power");
+    }
+    value.d = std::pow(value.d, exponent.convert(type).d);
+    return check_range(value);
+  }
+
+  bool parse_primary(ConstantValue &value) {
+    skip_space();
+    if (pos == expr.size()) {
+      return fail("unexpected end of expression");
+    }
+    char c = expr[pos];
+    if (c == '(') {
+      pos++;
+      if (!parse_expr(value)) {
+        return false;
+      }
+      if (!accept(")")) {
+        return fail("missing )");
+      }
+      return true;
+    }
+    if (std::isdigit((unsigned char)c) || (c == '.')) {
+      return parse_literal(value);
+    }
+    if (std::isalpha((unsigned char)c) || (c == '_')) {
+      size_t start = pos;
+      while ((pos < expr.size()) && (std::isalnum((unsigned char)expr[pos]) ||
+                                     (expr[pos] == '_'))) {
+        pos++;
+      }
+      std::string name = expr.substr(start, pos - start);
+      skip_space();
+      if ((pos < expr.size()) && (expr[pos] == '(')) {
+        return fail(fmt::format("cannot fold the function call {}(...)", name));
+      }
+      auto constant = symbols.find(name);
+      if (!constant) {
+        return fail(fmt::format(
+            symbols.declared(name)
+                ? "parameter \"{}\" is not a folded numeric constant"
+                : "\"{}\" is not a parameter declared before this one",
+            name));
+      }
+      value = *constant;
+      return true;
+    }
+    return fail(fmt::format("unexpected \"{}\"", expr.substr(pos)));
+  }
+
+  // Fortran literals: without a decimal point or exponent they are integers,
+  // a D exponent makes a double and anything else a default real, a float
+  bool parse_literal(ConstantValue &value) {
+    size_t start = pos;
+    bool real = false, dexp = false;
+    while ((pos < expr.size()) && std::isdigit((unsigned char)expr[pos])) {
+      pos++;
+    }
+    if ((pos < expr.size()) && (expr[pos] == '.')) {
+      real = true;
+      pos++;
+      while ((pos < expr.size()) && std::isdigit((unsigned char)expr[pos])) {
+        pos++;
+      }
+    }
+    std::string digits = expr.substr(start, pos - start);
+    if ((pos < expr.size()) && std::strchr("eEdD", expr[pos])) {
+      real = true;
+      dexp = (expr[pos] == 'd') || (expr[pos] == 'D');
+      pos++;
+      size_t exp_start = pos;
+      if ((pos < expr.size()) && ((expr[pos] == '+') || (expr[pos] == '-'))) {
+        pos++;
+      }
+      while ((pos < expr.size()) && std::isdigit((unsigned char)expr[pos])) {
+        pos++;
+      }
+      digits += "E" + expr.substr(exp_start, pos - exp_start);
+    }
+    if ((digits == ".") || digits.empty()) {
+      return fail("malformed number");
+    }
+
+    try {
+      if (real) {
+        value.type = dexp ? FieldType::kDouble : FieldType::kFloat;
+        value.d = std::stod(digits);
+      } else {
+        value.type = FieldType::kInteger;
+        value.i = std::stoll(digits);
+      }
+    } catch (std::exception const &) {
+      return fail(fmt::format("malformed number \"{}\"", digits));
+    }
+    return check_range(value);
+  }
+};
+
+} // namespace
+
+bool SymbolTable::evaluate(std::string const &expr, ConstantValue &value,
+                           std::string &error) const {
+  ExpressionParser parser(expr, *this);
+  if (!parser.parse(value)) {
+    error = parser.error;
+    return false;
+  }
+  return true;
+}
+
+SymbolTable ResolveParameters(ParameterFields &parameters) {
+  SymbolTable symbols;
+  for (auto &p : parameters) {
+    if (symbols.declared(p.name)) {
+      Error("Parameter \"", p.name, "\" is declared more than once.");
+    }
+
+    bool numeric = p.is_integer() || p.is_floating();
+    if (!numeric) {
+      symbols.define_opaque(p.name, p.type);
+      continue;
+    }
+
+    // literals from the descriptor already have the kind of the parameter
+    ConstantValue value;
+    if (p.is_numeric) {
+      value.type = p.type;
+      if (p.is_integer()) {
+        value.i = std::stoll(p.value);
+      } else {
+        value.d = std::stod(p.value);
+      }
+      symbols.define(p.name, value.convert(p.type));
+      continue;
+    }
+
+    std::string error;
+    if (!symbols.evaluate(p.value, value, error)) {
+      std::cout << "[WARN]: Parameter \"" << p.name << "\" = \"" << p.value
+                << "\" cannot be folded to a constant: " << error
+                << ". It is emitted as written and cannot size fields."
+                << std::endl;
+      symbols.define_opaque(p.name, p.type);
+      continue;
+    }
+    value = value.convert(p.type);
+    symbols.define(p.name, value);
+    p.value = value.literal();
+    p.is_numeric = true;
+  }
+  return symbols;
+}
+
+int ResolveExtent(std::variant<int, std::string> const &dim,
+                  SymbolTable const &symbols, std::string const &context) {
+  if (dim.index() == FieldDescriptor::kSizeInt) {
+    return std::get<FieldDescriptor::kSizeInt>(dim);
+  }
+
+  auto const &expr = std::get<FieldDescriptor::kSizeString>(dim);
+  ConstantValue value;
+  std::string error;
+  if (!symbols.evaluate(expr, value, error)) {
+    Error(context, " has extent: \"", expr, "\", which cannot be folded to a "
+          "constant: ", error, ".");
+  }
+  if (!value.is_integer()) {
+    Error(context, " has extent: \"", expr, "\", which is of non-integer type: "
+          "", value.type);
+  }
+  return int(value.i);
+}
+
+void ResolveShape(FieldDescriptor &fd, SymbolTable const &symbols,
+                  std::string const &dtypename) {
+  std::string context =
+      fmt::format("Field \"{}\" on type \"{}\"", fd.name, dtypename);
+  fd.shape.clear();
+  for (auto const &dim : fd.size) {
+    int extent = ResolveExtent(dim, symbols, context);
+    if (extent < 1) {
+      Error(context, " has a dimension of extent ", extent, ", expected a "
+            "positive integer.");
+    }
+    fd.shape.push_back(extent);
+  }
+}
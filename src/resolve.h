@@ -0,0 +1,70 @@
+#pragma once
+
+#include "types.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+// A numeric constant of one of the interoperable kinds. Floats are kept as
+// doubles that are always representable as a float.
+struct ConstantValue {
+  FieldType type = FieldType::kInteger;
+  int64_t i = 0;
+  double d = 0;
+
+  bool is_integer() const { return type == FieldType::kInteger; }
+  double as_double() const { return is_integer() ? double(i) : d; }
+
+  // this value converted as by Fortran intrinsic assignment to type ft
+  ConstantValue convert(FieldType ft) const;
+
+  // a literal that reads back as exactly this value in both languages
+  std::string literal() const;
+};
+
+// Numeric parameters by name, with every value folded to a constant
+class SymbolTable {
+  std::unordered_map<std::string, ConstantValue> constants;
+  // parameters that are not numeric or could not be folded, which are still
+  // reported by name rather than as unknown
+  std::unordered_map<std::string, FieldType> opaque;
+
+public:
+  void define(std::string const &name, ConstantValue const &value) {
+    constants[name] = value;
+  }
+  void define_opaque(std::string const &name, FieldType type) {
+    opaque[name] = type;
+  }
+
+  bool declared(std::string const &name) const {
+    return constants.count(name) || opaque.count(name);
+  }
+
+  ConstantValue const *find(std::string const &name) const {
+    auto it = constants.find(name);
+    return (it == constants.end()) ? nullptr : &it->second;
+  }
+
+  // Folds a Fortran constant expression of numeric literals, previously
+  // defined parameters, parentheses and the operators + - * / **, with
+  // Fortran's kinds and conversions. Returns false with a message in error if
+  // expr cannot be folded.
+  bool evaluate(std::string const &expr, ConstantValue &value,
+                std::string &error) const;
+};
+
+// Folds every numeric parameter to a literal, in declaration order so that
+// parameters may refer to those declared before them. Expressions that cannot
+// be folded are left as they are with a warning, and cannot size fields.
+SymbolTable ResolveParameters(ParameterFields &parameters);
+
+// The extent of a dimension or a number of instances, which must fold to a
+// positive integer. context names the owner in error messages.
+int ResolveExtent(std::variant<int, std::string> const &dim,
+                  SymbolTable const &symbols, std::string const &context);
+
+// Resolves the declared size of fd to the extents of its shape
+void ResolveShape(FieldDescriptor &fd, SymbolTable const &symbols,
+                  std::string const &dtypename);
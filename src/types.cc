@@ -1,8 +1,10 @@
 #include "types.h"
+#include "utils.h"
 
 #include "fmt/core.h"
 #include "fmt/format.h"
 
+#include <algorithm>
 #include <iostream>
 
 namespace toml {
@@ -22,8 +24,7 @@ FieldType from<FieldType>::from_toml(const value &v) {
   } else if (typenm == "bool") {
     return FieldType::kBool;
   } else {
-    std::cout << "[ERROR]: Unhandled FieldType: " << typenm << std::endl;
-    abort();
+    Error("Unhandled FieldType: ", typenm);
   }
 }
 
@@ -31,9 +32,43 @@ AttributeType from<AttributeType>::from_toml(const value &v) {
   auto typenm = get<std::string>(v);
   if (typenm == "configurable") {
     return AttributeType::kConfigurable;
+  } else if (typenm == "hot") {
+    return AttributeType::kHot;
   } else {
-    std::cout << "[ERROR]: Unhandled AttributeType: " << typenm << std::endl;
-    abort();
+    Error("Unhandled AttributeType: ", typenm);
+  }
+}
+
+ConcurrencyMode from<ConcurrencyMode>::from_toml(const value &v) {
+  auto modenm = get<std::string>(v);
+  if (modenm == "none") {
+    return ConcurrencyMode::kNone;
+  } else if (modenm == "seqlock") {
+    return ConcurrencyMode::kSeqLock;
+  } else {
+    Error("Unhandled ConcurrencyMode: ", modenm);
+  }
+}
+
+InstanceLayout from<InstanceLayout>::from_toml(const value &v) {
+  auto layoutnm = get<std::string>(v);
+  if (layoutnm == "aos") {
+    return InstanceLayout::kArrayOfStructs;
+  } else if (layoutnm == "soa") {
+    return InstanceLayout::kStructOfArrays;
+  } else {
+    Error("Unhandled InstanceLayout: ", layoutnm);
+  }
+}
+
+InstanceStorage from<InstanceStorage>::from_toml(const value &v) {
+  auto storagenm = get<std::string>(v);
+  if (storagenm == "static") {
+    return InstanceStorage::kStatic;
+  } else if (storagenm == "shm") {
+    return InstanceStorage::kSharedMemory;
+  } else {
+    Error("Unhandled InstanceStorage: ", storagenm);
   }
 }
 
@@ -68,23 +103,17 @@ from<ParameterFieldDescriptor>::from_toml(const value &v) {
       f.is_numeric = false;
       f.value = val.as_boolean() ? "true" : "false";
     } else {
-      std::cout << "[ERROR]: Failed to parse parameter value as known type: "
-                << val.as_string() << std::endl;
-      abort();
+      Error("Failed to parse parameter value as known type: ", val.as_string());
     }
   } catch (toml::exception e) {
-    std::cout << "[ERROR]: Failed to parse parameter value: " << e.what()
-              << std::endl;
-    abort();
+    Error("Failed to parse parameter value: ", e.what());
   } catch (fmt::format_error e) {
-    std::cout << "[ERROR]: Failed to format value: " << e.what() << std::endl;
-    abort();
+    Error("Failed to format value: ", e.what());
+  } catch (GeneratorError const &) {
+    throw;
   } catch (...) {
-    std::cout
-        << "[ERROR]: Unspecified exception when parsing parameter value. "
-           "Please report this message and your input file to the developer."
-        << std::endl;
-    abort();
+    Error("Unspecified exception when parsing parameter value. Please report "
+          "this message and your input file to the developer.");
   }
 
   return f;
@@ -102,14 +131,18 @@ FieldDescriptor from<FieldDescriptor>::from_toml(const value &v) {
   }
   f.comment = find_or<std::string>(v, "comment", "");
 
+  f.align = find_or<int>(v, "align", 0);
+  if ((f.align < 0) || (f.align & (f.align - 1))) {
+    Error("When parsing descriptor for field: \"", f.name, "\", align = ",
+          f.align, " is not a power of two number of bytes.");
+  }
+
   if (v.contains("size")) {
     auto size_element = find(v, "size");
     if (size_element.is_array()) {
       if (f.is_string() && (size_element.as_array().size() > 1)) {
-        std::cout << "[ERROR]: We cannot currently handle arrays of strings, "
-                     "please submit an issue/PR if this is a problem."
-                  << std::endl;
-        abort();
+        Error("We cannot currently handle arrays of strings, please submit an "
+              "issue/PR if this is a problem.");
       }
 
       size_t ind = 0;
@@ -119,10 +152,8 @@ FieldDescriptor from<FieldDescriptor>::from_toml(const value &v) {
         } else if (el.is_string()) {
           f.size.emplace_back(get<std::string>(el));
         } else {
-          std::cout << "[ERROR] When parsing descriptor for field: \"" << f.name
-                    << "\", found invalid size element type at index: " << ind
-                    << std::endl;
-          abort();
+          Error("When parsing descriptor for field: \"", f.name, "\", found "
+                "invalid size element type at index: ", ind);
         }
         ind++;
       }
@@ -132,9 +163,8 @@ FieldDescriptor from<FieldDescriptor>::from_toml(const value &v) {
       } else if (size_element.is_string()) {
         f.size.emplace_back(get<std::string>(size_element));
       } else {
-        std::cout << "[ERROR] When parsing descriptor for field: \"" << f.name
-                  << "\", found invalid size element type " << std::endl;
-        abort();
+        Error("When parsing descriptor for field: \"", f.name, "\", found "
+              "invalid size element type ");
       }
     }
   }
@@ -153,10 +183,8 @@ FieldDescriptor from<FieldDescriptor>::from_toml(const value &v) {
         } else if (el.is_boolean()) {
           f.data.emplace_back(get<bool>(el));
         } else {
-          std::cout << "[ERROR] When parsing descriptor for field: \"" << f.name
-                    << "\", found invalid element type at index: " << ind
-                    << std::endl;
-          abort();
+          Error("When parsing descriptor for field: \"", f.name, "\", found "
+                "invalid element type at index: ", ind);
         }
         ind++;
       }
@@ -170,9 +198,8 @@ FieldDescriptor from<FieldDescriptor>::from_toml(const value &v) {
       } else if (data_element.is_boolean()) {
         f.data.emplace_back(int(get<bool>(data_element)));
       } else {
-        std::cout << "[ERROR] When parsing descriptor for field: \"" << f.name
-                  << "\", found invalid element type " << std::endl;
-        abort();
+        Error("When parsing descriptor for field: \"", f.name, "\", found "
+              "invalid element type ");
       }
     }
   }
@@ -182,6 +209,45 @@ FieldDescriptor from<FieldDescriptor>::from_toml(const value &v) {
 
 } // namespace toml
 
+DerivedTypeLayout GetLayout(DerivedType const &dtype) {
+  DerivedTypeLayout dtl;
+  for (auto const &fd : dtype.fields) {
+    FieldLayout fl;
+    fl.name = fd.name;
+    fl.alignment = fd.get_alignment();
+    fl.size = fd.get_element_size() * fd.get_storage_size();
+    fl.padding = (fl.alignment - (dtl.size % fl.alignment)) % fl.alignment;
+    fl.offset = dtl.size + fl.padding;
+
+    dtl.size = fl.offset + fl.size;
+    dtl.alignment = std::max(dtl.alignment, fl.alignment);
+    dtl.fields.push_back(fl);
+  }
+  dtl.tail_padding =
+      (dtl.alignment - (dtl.size % dtl.alignment)) % dtl.alignment;
+  dtl.size += dtl.tail_padding;
+  return dtl;
+}
+
+int64_t GetLayoutHash(std::string const &dtypename, DerivedType const &dtype) {
+  auto dtl = GetLayout(dtype);
+  std::stringstream ss("");
+  ss << dtypename << ":" << dtl.size << ":" << dtype.get_instance_count();
+  for (size_t i = 0; i < dtype.fields.size(); ++i) {
+    ss << ";" << dtype.fields[i].type << ":" << dtype.fields[i].name << "("
+       << dtype.fields[i].get_cshape_str() << ")@"
+       << dtl.fields[i].offset;
+  }
+  return int64_t(fnv1a(ss.str()) & 0x7fffffffffffffffULL);
+}
+
+void PackFields(DerivedType &dtype) {
+  std::stable_sort(dtype.fields.begin(), dtype.fields.end(),
+                   [](FieldDescriptor const &a, FieldDescriptor const &b) {
+                     return a.get_alignment() > b.get_alignment();
+                   });
+}
+
 std::ostream &operator<<(std::ostream &os, FieldType ft) {
   switch (ft) {
   case FieldType::kInteger: {
@@ -211,6 +277,9 @@ std::ostream &operator<<(std::ostream &os, AttributeType ft) {
   case AttributeType::kConfigurable: {
     return os << "configurable";
   }
+  case AttributeType::kHot: {
+    return os << "hot";
+  }
   }
   return os;
 }
@@ -245,6 +314,11 @@ std::string to_string(FieldType ft) {
   ss << ft;
   return ss.str();
 }
+std::string to_string(AttributeType at) {
+  std::stringstream ss("");
+  ss << at;
+  return ss.str();
+}
 std::string to_string(ParameterFieldDescriptor const &fd) {
   std::stringstream ss("");
   ss << fd;
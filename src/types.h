@@ -1,17 +1,22 @@
 #pragma once
 
 #include "toml.hpp"
+#include "utils.h"
 
+#include <algorithm>
 #include <iostream>
 #include <ostream>
 #include <set>
 #include <string>
-#include <unordered_map>
+#include <utility>
 #include <variant>
 #include <vector>
 
 enum class FieldType { kInteger, kString, kCharacter, kFloat, kDouble, kBool };
-enum class AttributeType { kConfigurable };
+enum class AttributeType { kConfigurable, kHot };
+enum class ConcurrencyMode { kNone, kSeqLock };
+enum class InstanceLayout { kArrayOfStructs, kStructOfArrays };
+enum class InstanceStorage { kStatic, kSharedMemory };
 
 struct ParameterFieldDescriptor {
   std::string name;
@@ -36,64 +41,60 @@ struct FieldDescriptor {
 
   std::string name;
   FieldType type;
+  // extents as declared, literals or parameter expressions
   std::vector<std::variant<int, std::string>> size;
+  // extents with every expression folded, see ResolveShape
+  std::vector<int> shape;
   std::set<AttributeType> attributes;
   std::string comment;
   using data_element_type = std::variant<int, double, std::string>;
   std::vector<data_element_type> data;
+  // requested alignment in bytes, 0 for natural alignment
+  int align = 0;
 
-  int get_size(ParameterFields const &parameters) const {
+  int get_size() const {
     int full_size = 1;
     for (int i = 0; i < size.size(); ++i) {
-      full_size *= get_dim_size(i, parameters);
+      full_size *= get_dim_size(i);
     }
     return full_size;
   }
 
-  std::string get_fort_shape_str(ParameterFields const &parameters) const {
+  // number of elements in memory, including the C_NULL_CHAR slot of strings
+  int get_storage_size() const { return get_size() + (is_string() ? 1 : 0); }
+
+  std::string get_fort_shape_str() const {
     std::stringstream ss("");
     for (int i = 0; i < size.size(); ++i) {
-      ss << get_dim_size(i, parameters) << ((i + 1 == size.size()) ? "" : ":");
+      ss << get_dim_size(i) << ((i + 1 == size.size()) ? "" : ":");
     }
     return ss.str();
   }
 
-  std::string get_cshape_str(ParameterFields const &parameters) const {
+  std::string get_cshape_str() const {
     std::stringstream ss("");
     for (int i = size.size(); i > 0; --i) {
-      ss << "[" << get_dim_size(i - 1, parameters) << "]";
+      ss << "[" << get_dim_size(i - 1) << "]";
     }
     return ss.str();
   }
 
-  int get_dim_size(int i, ParameterFields const &parameters) const {
+  int get_dim_size(int i) const {
     if (i >= size.size()) {
-      std::cout << "[ERROR]: When accessing dimension size for field: " << name
-                << " asked for size of dimension: " << i << ", but " << name
-                << " only has " << size.size() << " dimensions." << std::endl;
-      abort();
+      Error("When accessing dimension size for field: ", name, " asked for "
+            "size of dimension: ", i, ", but ", name, " only has ", size.size(),
+            " dimensions.");
     }
-    auto const &dim = size[i];
-    if (dim.index() == FieldDescriptor::kSizeString) {
-
-      for (auto const &p : parameters) {
-        if (std::get<FieldDescriptor::kSizeString>(dim) == p.name) {
-          return std::stol(p.value);
-        }
-      }
-      std::cout << "[ERROR]: No known parameter named: "
-                << std::get<FieldDescriptor::kSizeString>(dim) << std::endl;
-      abort();
-    } else {
-      return std::get<FieldDescriptor::kSizeInt>(dim);
+    if (shape.size() != size.size()) {
+      Error("The shape of field: ", name, " was used before it was resolved.");
     }
+    return shape[i];
   }
   std::string get_dim_size_str(int i) const {
     if (i >= size.size()) {
-      std::cout << "[ERROR]: When accessing dimension size for field: " << name
-                << " asked for size of dimension: " << i << ", but " << name
-                << " only has " << size.size() << " dimensions." << std::endl;
-      abort();
+      Error("When accessing dimension size for field: ", name, " asked for "
+            "size of dimension: ", i, ", but ", name, " only has ", size.size(),
+            " dimensions.");
     }
     auto const &dim = size[i];
     if (dim.index() == FieldDescriptor::kSizeString) {
@@ -103,16 +104,139 @@ struct FieldDescriptor {
     }
   }
 
+  // bytes per element, shared by the interoperable Fortran kind and C type
+  int get_element_size() const {
+    switch (type) {
+    case FieldType::kInteger:
+    case FieldType::kFloat: {
+      return 4;
+    }
+    case FieldType::kDouble: {
+      return 8;
+    }
+    case FieldType::kString:
+    case FieldType::kCharacter:
+    case FieldType::kBool: {
+      return 1;
+    }
+    }
+    return 1;
+  }
+
+  // all interoperable field types are naturally aligned, a larger alignment
+  // can be requested
+  int get_alignment() const { return std::max(align, get_element_size()); }
+  bool is_overaligned() const { return align > get_element_size(); }
+
   bool is_array() const { return size.size(); }
   bool is_string() const { return (type == FieldType::kString); }
+  bool is_hot() const { return attributes.count(AttributeType::kHot); }
 };
 
 struct DerivedType {
   std::string comment;
   std::vector<FieldDescriptor> fields;
+  ConcurrencyMode concurrency = ConcurrencyMode::kNone;
+  bool threadprivate = false;
+  // number of instances, 0 for the default single global instance
+  int instances = 0;
+  InstanceLayout layout = InstanceLayout::kArrayOfStructs;
+  // fields are reordered to minimize padding
+  bool pack = false;
+  // default alignment in bytes of array fields, 0 for natural alignment
+  int align = 0;
+  InstanceStorage storage = InstanceStorage::kStatic;
+
+  bool is_seqlocked() const { return concurrency == ConcurrencyMode::kSeqLock; }
+  bool is_shared() const { return storage == InstanceStorage::kSharedMemory; }
+  // the instance and its modification counter are not bind(C) globals, C and
+  // C++ reach them through pointers returned by Fortran
+  bool has_instance_pointer() const { return threadprivate || is_shared(); }
+  // struct-of-arrays types are folded into a single instance with an extra
+  // outer dimension on every field, so only array-of-structs types need an
+  // instance index
+  bool is_instance_array() const {
+    return instances && (layout == InstanceLayout::kArrayOfStructs);
+  }
+  // number of bind(C) instances in the global, struct-of-arrays types have
+  // one that already spans every instance
+  int get_instance_count() const {
+    return is_instance_array() ? instances : 1;
+  }
+
+  // types with over-aligned fields spell out all padding as explicit members
+  bool has_explicit_padding() const {
+    for (auto const &fd : fields) {
+      if (fd.is_overaligned()) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool has_hot_fields() const {
+    for (auto const &fd : fields) {
+      if (fd.is_hot()) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // the hot or the cold fields as a standalone type, used for the sub-structs
+  // that move only part of an instance
+  DerivedType get_hot_cold_part(bool hot) const {
+    DerivedType part;
+    for (auto const &fd : fields) {
+      if (fd.is_hot() == hot) {
+        part.fields.push_back(fd);
+      }
+    }
+    return part;
+  }
+};
+
+// Named types in descriptor order, which is the order they are generated in
+using DerivedTypes = std::vector<std::pair<std::string, DerivedType>>;
+
+struct FieldLayout {
+  std::string name;
+  int offset;
+  int size;
+  int alignment;
+  // bytes inserted before this field to align it
+  int padding;
+};
+
+// Memory layout of a derived type, identical for the bind(C) Fortran type and
+// the C struct
+struct DerivedTypeLayout {
+  std::vector<FieldLayout> fields;
+  int size = 0;
+  int alignment = 1;
+  // bytes after the last field that keep consecutive instances aligned
+  int tail_padding = 0;
+
+  int get_padding() const {
+    int padding = tail_padding;
+    for (auto const &fl : fields) {
+      padding += fl.padding;
+    }
+    return padding;
+  }
 };
 
-using DerivedTypes = std::unordered_map<std::string, DerivedType>;
+DerivedTypeLayout GetLayout(DerivedType const &dtype);
+
+// Hash of everything that determines the bytes of an instance: field names,
+// types, shapes and offsets, the type size and the number of instances.
+// Truncated to 63 bits so that it is representable as a Fortran integer.
+int64_t GetLayoutHash(std::string const &dtypename, DerivedType const &dtype);
+
+// Stable sort of the fields by decreasing alignment, which minimizes padding
+// for naturally aligned fields. Fields with an explicit alignment larger than
+// their size can still leave gaps.
+void PackFields(DerivedType &dtype);
 
 namespace toml {
 
@@ -124,6 +248,18 @@ template <> struct from<AttributeType> {
   static AttributeType from_toml(const value &v);
 };
 
+template <> struct from<ConcurrencyMode> {
+  static ConcurrencyMode from_toml(const value &v);
+};
+
+template <> struct from<InstanceLayout> {
+  static InstanceLayout from_toml(const value &v);
+};
+
+template <> struct from<InstanceStorage> {
+  static InstanceStorage from_toml(const value &v);
+};
+
 template <> struct from<ParameterFieldDescriptor> {
   static ParameterFieldDescriptor from_toml(const value &v);
 };
@@ -139,5 +275,6 @@ std::ostream &operator<<(std::ostream &os, ParameterFieldDescriptor const &fd);
 std::ostream &operator<<(std::ostream &os, FieldDescriptor const &fd);
 
 std::string to_string(FieldType ft);
+std::string to_string(AttributeType at);
 std::string to_string(ParameterFieldDescriptor const &fd);
 std::string to_string(FieldDescriptor const &fd);
\ No newline at end of file
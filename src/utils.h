@@ -1,6 +1,33 @@
 #pragma once
 
+#include "fmt/format.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// 64 bit FNV-1a hash, stable across platforms and generator builds. A
+// non-zero seed perturbs the offset basis to give a different hash function.
+inline uint64_t fnv1a(std::string_view str, uint64_t seed = 0) {
+  uint64_t hash = 14695981039346656037ULL ^ seed;
+  for (unsigned char c : str) {
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
 
 inline std::string SanitizeComment(std::string comment,
                                    std::string const &comment_characters) {
@@ -16,4 +43,142 @@ inline std::string SanitizeComment(std::string comment,
     next = comment.find('\n', next + 1);
   }
   return comment;
-}
\ No newline at end of file
+}
+// An invalid descriptor or a failed write, which stops the generation of one
+// descriptor. The message starts with [ERROR]: and is reported by the caller,
+// so that the other descriptors of a batch still complete.
+class GeneratorError : public std::runtime_error {
+public:
+  using std::runtime_error::runtime_error;
+};
+
+// Throws a GeneratorError with the arguments streamed into the message
+template <typename... T> [[noreturn]] void Error(T const &...args) {
+  std::stringstream ss;
+  ss << "[ERROR]: ";
+  (ss << ... << args);
+  throw GeneratorError(ss.str());
+}
+
+// Stands in for the content hash in the comment that starts every generated
+// file, it is exactly as long as the hash
+constexpr char kContentHashPlaceholder[] = "@content-hash@@@";
+
+// Generated code is rendered into memory and the output file is only
+// replaced when its content changes, so that regenerating an unchanged
+// module does not touch its timestamp and cascade into dependent rebuilds
+class OutputBuffer {
+  fmt::memory_buffer buf;
+
+public:
+  template <typename... T>
+  void print(fmt::format_string<T...> fmt, T &&...args) {
+    fmt::format_to(fmt::appender(buf), fmt, std::forward<T>(args)...);
+  }
+
+  // Appends parts in order, releasing each one once it is copied
+  void append(std::vector<OutputBuffer> &parts) {
+    size_t size = buf.size();
+    for (auto const &part : parts) {
+      size += part.buf.size();
+    }
+    buf.reserve(size);
+    for (auto &part : parts) {
+      buf.append(part.buf);
+      part = OutputBuffer();
+    }
+  }
+
+  std::string str() const { return fmt::to_string(buf); }
+
+  // Replaces kContentHashPlaceholder near the start of the buffer with the
+  // hash of the content, so that a file only changes when its own content
+  // does. The hash covers the content with the placeholder in place.
+  void StampContentHash() {
+    size_t len = std::strlen(kContentHashPlaceholder);
+    size_t end = std::min(buf.size(), size_t(1024));
+    auto it = std::search(buf.begin(), buf.begin() + end,
+                          kContentHashPlaceholder,
+                          kContentHashPlaceholder + len);
+    if (it == buf.begin() + end) {
+      return;
+    }
+    std::string hash = fmt::format(
+        "{:016x}", fnv1a(std::string_view(buf.data(), buf.size())));
+    std::copy(hash.begin(), hash.end(), it);
+  }
+
+  // Returns whether the file was written. New content goes to a temporary
+  // file first, so a failed write never leaves a truncated output behind.
+  bool WriteIfChanged(std::string const &fname) const {
+    {
+      std::ifstream existing(fname, std::ios::binary | std::ios::ate);
+      if (existing && (size_t(existing.tellg()) == buf.size())) {
+        std::string content(buf.size(), '\0');
+        existing.seekg(0);
+        if (existing.read(&content[0], std::streamsize(content.size())) &&
+            !std::memcmp(content.data(), buf.data(), buf.size())) {
+          return false;
+        }
+      }
+    }
+
+    std::string tmpname = fname + ".tmp";
+    {
+      // the buffer goes out in one write, not in stream buffer sized pieces
+      std::ofstream out(tmpname, std::ios::binary | std::ios::trunc);
+      out.write(buf.data(), std::streamsize(buf.size()));
+      out.close();
+      if (!out) {
+        std::remove(tmpname.c_str());
+        Error("Failed to write output file: ", tmpname);
+      }
+    }
+    if (std::rename(tmpname.c_str(), fname.c_str())) {
+      std::remove(tmpname.c_str());
+      Error("Failed to replace output file: ", fname);
+    }
+    return true;
+  }
+};
+
+// Calls body(i) for every i in [0, n) on up to nthreads threads, which take
+// indices in order. The calls must be independent of each other. The first
+// exception thrown by body stops the remaining calls and is rethrown once all
+// threads have finished.
+template <typename F> void ParallelFor(size_t n, int nthreads, F const &body) {
+  nthreads = int(std::min(size_t(std::max(nthreads, 1)), n));
+  if (nthreads <= 1) {
+    for (size_t i = 0; i < n; ++i) {
+      body(i);
+    }
+    return;
+  }
+
+  std::atomic<size_t> next{0};
+  std::mutex error_mutex;
+  std::exception_ptr error;
+  auto worker = [&]() {
+    for (size_t i = next++; i < n; i = next++) {
+      try {
+        body(i);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+        next = n;
+      }
+    }
+  };
+  std::vector<std::thread> pool;
+  for (int t = 0; t < nthreads; ++t) {
+    pool.emplace_back(worker);
+  }
+  for (auto &t : pool) {
+    t.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
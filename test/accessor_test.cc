@@ -0,0 +1,124 @@
+#include "testmod.h"
+#include "test_asserts.h"
+
+#include "fmt/core.h"
+
+#include <cmath>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern "C" {
+void fortwrite();
+}
+
+using namespace FortMod;
+
+// exit status of a child process that calls f, which must not return
+template <typename F> int ChildExitStatus(F const &f) {
+  pid_t pid = fork();
+  if (pid == 0) {
+    f();
+    _exit(0);
+  }
+  int status = 0;
+  waitpid(pid, &status, 0);
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+int main() {
+  fortwrite();
+
+  // scalar getters
+  CPPAssert(testtype1IF::get_fbool(), true);
+  CPPAssert_float(testtype1IF::get_ffloat(), 1.2345678);
+  CPPAssert(testtype1IF::get_fstr(), std::string("string from fortran"));
+
+  // element getters take C-order indices
+  CPPAssert_float(testtype2IF::get_ffloata_elem(3), 4);
+  CPPAssert_float(testtype2IF::get_ffloat2a_elem(4, 2), 114);
+  CPPAssert(testtype2IF::get_fint3dim_elem(3, 2, 1), 10023);
+
+  // slice getters use flat offsets into the field storage
+  float slice[4];
+  testtype2IF::get_ffloat2a_slice(5, 4, slice);
+  for (int i = 0; i < 4; ++i) {
+    CPPAssert_float(slice[i], 105 + i);
+  }
+
+  float whole[5][2];
+  testtype2IF::get_ffloat2apar(&whole[0][0]);
+  CPPAssert_float(whole[3][1], 1007);
+
+  // setters are visible through the whole-struct interface
+  testtype1IF::set_fbool(false);
+  testtype1IF::set_fdouble(2.5);
+  testtype1IF::set_fstr("set per field");
+  testtype2IF::set_fint3dim_elem(1, 2, 0, -7);
+  float newslice[3] = {-1, -2, -3};
+  testtype2IF::set_ffloata_slice(2, 3, newslice);
+
+  auto myinst1 = testtype1IF::copy();
+  auto myinst2 = testtype2IF::copy();
+  CPPAssert(myinst1.fbool, false);
+  CPPAssert(myinst1.fdouble, 2.5);
+  CPPAssert(myinst1.get_fstr(), std::string("set per field"));
+  CPPAssert(myinst2.fint3dim[1][2][0], -7);
+  CPPAssert_float(myinst2.ffloata[1], 2);
+  CPPAssert_float(myinst2.ffloata[4], -3);
+
+  // transactions only write back the fields that they touched
+  {
+    testtype2IF::transaction tx;
+    tx.fint3dim()[0][0][1] = 42;
+    testtype2IF::set_ffloata_elem(0, 77);
+  }
+  CPPAssert(testtype2IF::get_fint3dim_elem(0, 0, 1), 42);
+  CPPAssert(testtype2IF::get_fint3dim_elem(1, 2, 0), -7);
+  CPPAssert_float(testtype2IF::get_ffloata_elem(0), 77);
+
+  // offsets outside of the field stop with an error
+  float big[6] = {0};
+  float last = testtype2IF::get_ffloata_elem(4);
+  CPPAssert(ChildExitStatus([]() { testtype2IF::get_ffloata_elem(5); }), 1);
+  CPPAssert(ChildExitStatus([]() { testtype2IF::set_ffloata_elem(-1, 0); }),
+            1);
+  auto get_past_end = [&]() { testtype2IF::get_ffloata_slice(0, 6, big); };
+  auto set_past_end = [&]() { testtype2IF::set_ffloata_slice(3, 3, big); };
+  auto set_empty_at_end = [&]() { testtype2IF::set_ffloata_slice(5, 0, big); };
+  CPPAssert(ChildExitStatus(get_past_end), 1);
+  CPPAssert(ChildExitStatus(set_past_end), 1);
+  CPPAssert(ChildExitStatus(set_empty_at_end), 0);
+  CPPAssert_float(testtype2IF::get_ffloata_elem(4), last);
+
+  {
+    testtype1IF::transaction tx;
+    tx.set_ffloat(9.5);
+    tx.set_fstr("from a transaction");
+    CPPAssert(tx.get_fdouble(), 2.5);
+    CPPAssert_float(tx.get_ffloat(), 9.5);
+    CPPAssert_float(testtype1IF::get_ffloat(), 1.2345678);
+    tx.commit();
+    CPPAssert_float(testtype1IF::get_ffloat(), 9.5);
+
+    tx.set_fdouble(-1);
+    tx.discard();
+  }
+  CPPAssert(testtype1IF::get_fdouble(), 2.5);
+  CPPAssert(testtype1IF::get_fstr(), std::string("from a transaction"));
+
+  // cached snapshots are only copied again once the instance was modified
+  testtype1IF::cached cache;
+  CPPAssert(cache.stale(), true);
+  CPPAssert(cache.get().fdouble, 2.5);
+  CPPAssert(cache.stale(), false);
+
+  auto version = testtype1IF::version();
+  testtype1IF::set_fdouble(4.5);
+  CPPAssert((testtype1IF::version() > version), true);
+  CPPAssert(cache.stale(), true);
+  CPPAssert(cache.get().fdouble, 4.5);
+
+  testtype1IF::touch();
+  CPPAssert(cache.stale(), true);
+}
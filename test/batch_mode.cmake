@@ -0,0 +1,65 @@
+# Generates the module twice through a batch manifest, on two threads, and
+# checks that both outputs match a single descriptor run, then that an invalid
+# descriptor fails the batch without stopping the others.
+# Run with -DFORTMODGEN=<generator> -DDESCRIPTOR=<toml> -DWORKDIR=<dir>
+
+file(REMOVE_RECURSE ${WORKDIR})
+file(MAKE_DIRECTORY ${WORKDIR}/single ${WORKDIR}/a ${WORKDIR}/b)
+
+execute_process(COMMAND ${FORTMODGEN} -i ${DESCRIPTOR} -o single/out
+  WORKING_DIRECTORY ${WORKDIR} RESULT_VARIABLE status OUTPUT_QUIET)
+if(NOT status EQUAL 0)
+  message(FATAL_ERROR "fortmodgen failed for a single descriptor")
+endif()
+
+file(WRITE ${WORKDIR}/manifest.txt
+  "# descriptor output-stub\n${DESCRIPTOR} a/out\n\n${DESCRIPTOR}   b/out\n")
+execute_process(COMMAND ${FORTMODGEN} --batch manifest.txt -j 2
+  WORKING_DIRECTORY ${WORKDIR} RESULT_VARIABLE status OUTPUT_QUIET)
+if(NOT status EQUAL 0)
+  message(FATAL_ERROR "fortmodgen failed in batch mode")
+endif()
+
+foreach(run a b)
+  foreach(ext .f90 .h _structs.h _c.h _strings.h _cpp.h _print.h _shm.c
+              _seqlock.c)
+    execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files
+      ${WORKDIR}/single/out${ext} ${WORKDIR}/${run}/out${ext}
+      RESULT_VARIABLE status)
+    if(NOT status EQUAL 0)
+      message(FATAL_ERROR "${run}/out${ext} differs from the single run")
+    endif()
+  endforeach()
+endforeach()
+
+# a descriptor that fails is reported with its path, the others are still
+# generated and the run fails without marking the batch as done
+file(MAKE_DIRECTORY ${WORKDIR}/c ${WORKDIR}/d)
+file(WRITE ${WORKDIR}/bad.toml "[module]
+name = \"bad\"
+derivedtypes = [\"t\"]
+[module.t]
+fields = [ { name = \"a\", type = \"complex\" } ]
+")
+file(WRITE ${WORKDIR}/manifest_bad.txt "bad.toml c/out\n${DESCRIPTOR} d/out\n")
+execute_process(COMMAND ${FORTMODGEN} --batch manifest_bad.txt -j 2
+  --stamp batch.stamp
+  WORKING_DIRECTORY ${WORKDIR} RESULT_VARIABLE status OUTPUT_VARIABLE output)
+if(status EQUAL 0)
+  message(FATAL_ERROR "fortmodgen succeeded with an invalid descriptor")
+endif()
+if(NOT output MATCHES "Unhandled FieldType: complex\n\\[ERROR\\]: Failed to generate bad.toml")
+  message(FATAL_ERROR "the failing descriptor was not reported:\n${output}")
+endif()
+if(EXISTS ${WORKDIR}/batch.stamp)
+  message(FATAL_ERROR "the stamp was written although a descriptor failed")
+endif()
+execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files
+  ${WORKDIR}/single/out.f90 ${WORKDIR}/d/out.f90 RESULT_VARIABLE status)
+if(NOT status EQUAL 0)
+  message(FATAL_ERROR "the valid descriptor was not generated next to the invalid one")
+endif()
+file(GLOB_RECURSE leftovers ${WORKDIR}/*.tmp)
+if(leftovers)
+  message(FATAL_ERROR "temporary files were left behind: ${leftovers}")
+endif()
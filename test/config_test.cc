@@ -0,0 +1,46 @@
+#include "testmod.h"
+#include "test_asserts.h"
+
+#include "fmt/core.h"
+
+using namespace FortMod;
+
+int main(int argc, char const *argv[]) {
+  if (argc < 2) {
+    std::cout << "[ERROR]: expected the path to a configuration file."
+              << std::endl;
+    return 1;
+  }
+
+  CPPAssert(testmodConfig::load_config(argv[1]), FORTMODGEN_IO_OK);
+  CPPAssert(testtype1IF::get_fdouble(), 2.5e-3);
+  CPPAssert(testtype1IF::get_fstr(), std::string("configured # not a comment"));
+  int fint3dim[24];
+  testtype2IF::get_fint3dim_slice(0, 24, fint3dim);
+  for (int i = 0; i < 24; ++i) {
+    CPPAssert(fint3dim[i], (i + 1));
+  }
+  CPPAssert(testtype3IF::get_fcounter(), 12);
+  for (int idx = 0; idx < intpar; ++idx) {
+    CPPAssert(testtype5IF::get_fmass(idx), 0.938);
+  }
+
+  // only configurable fields can be reached by name
+  CPPAssert((testmodConfig::field_index("testtype1.fdouble") >= 0), true);
+  CPPAssert(testmodConfig::field_index("testtype1.ffloat"), -1);
+  CPPAssert(testmodConfig::field_index("testtype9.fdouble"), -1);
+  CPPAssert(testmodConfig::set_by_name("testtype1.ffloat", "1"), false);
+
+  // command-line style overrides
+  CPPAssert(testmodConfig::set_override("testtype1.fbool=false"), true);
+  CPPAssert(testtype1IF::get_fbool(), false);
+  CPPAssert(testmodConfig::set_override("testtype3.fcounter = 99"), true);
+  CPPAssert(testtype3IF::get_fcounter(), 99);
+  CPPAssert(testmodConfig::set_override("testtype3.fcounter = 9x"), false);
+  CPPAssert(testtype3IF::get_fcounter(), 99);
+  CPPAssert(testmodConfig::set_override("testtype2.fint3dim = [1, 2]"), false);
+  CPPAssert(testmodConfig::set_override("testtype1.fdouble"), false);
+
+  CPPAssert(testmodConfig::load_config("does/not/exist.toml"),
+            FORTMODGEN_IO_OPEN_FAILED);
+}
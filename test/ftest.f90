@@ -191,4 +191,10 @@ program ftest
   call cppwrite()
   call fortassert_cpp()
 
+  ! a blank string must not reuse the length from the previous call
+  call set_testtype1_fstr("abc")
+  call assert_str("ASSERT[FAILED] testtype1%fstr", get_testtype1_fstr(), "abc")
+  call set_testtype1_fstr("")
+  call assert_int("ASSERT[FAILED] len(testtype1%fstr)", len(get_testtype1_fstr()), 0)
+
 end program
\ No newline at end of file
@@ -29,4 +29,9 @@
 int main() {
   CPPAssert_float(floatpar,1.2345678);
   CPPAssert_double(doublepar,1.234567891011121);
+  // folded by the generator, but must be exactly what Fortran computes
+  if (floatparsq != floatpar * floatpar) {
+    std::cout << "ASSERT[FAILED]: floatparsq != floatpar*floatpar" << std::endl;
+    abort();
+  }
 }
\ No newline at end of file
@@ -52,4 +52,43 @@ module fwrite_mod
       end do
 
     end subroutine
+
+    ! n writes to the seqlocked testtype3, each of which leaves every element
+    ! of fdoublea equal to fcounter
+    subroutine fortran_seqlock_writer(n) bind(C, name="fortran_seqlock_writer")
+      use iso_c_binding
+      use testmod
+
+      integer(kind=C_INT), value :: n
+      type (t_testtype3), target :: inst
+      integer :: k
+
+      do k = 1, n
+        inst%fcounter = k
+        inst%fdoublea = k
+        if (mod(k, 2).eq.1) then
+          call update_testtype3(C_LOC(inst))
+        else
+          call update_testtype3_masked(C_LOC(inst), [3_C_INT64_T])
+        end if
+      end do
+    end subroutine
+
+    ! number of torn instances among n reads of testtype3
+    function fortran_seqlock_reader(n) bind(C, name="fortran_seqlock_reader") &
+&       result(ntorn)
+      use iso_c_binding
+      use testmod
+
+      integer(kind=C_INT), value :: n
+      integer(kind=C_INT) :: ntorn
+      type (t_testtype3), target :: inst
+      integer :: k
+
+      ntorn = 0
+      do k = 1, n
+        call copy_testtype3(C_LOC(inst))
+        if (any(inst%fdoublea.ne.inst%fcounter)) ntorn = ntorn + 1
+      end do
+    end function
 end module fwrite_mod
\ No newline at end of file
@@ -0,0 +1,41 @@
+#include "testmod.h"
+#include "test_asserts.h"
+
+#include "fmt/core.h"
+
+#include <cstddef>
+
+using namespace FortMod;
+
+int main() {
+  // hot fields lead the full struct
+  CPPAssert(offsetof(testtype8_t, fevent), size_t(0));
+  CPPAssert(offsetof(testtype8_t, fweight), size_t(8));
+  CPPAssert(offsetof(testtype8_t, ftag), size_t(16));
+  CPPAssert(sizeof(testtype8_hot_t), size_t(32));
+
+  auto hot = testtype8IF::copy_hot();
+  CPPAssert(hot.fweight, 1.);
+  hot.fevent = 42;
+  hot.fweight = 0.25;
+  hot.set_ftag("muon");
+  testtype8IF::update_hot(hot);
+
+  auto cold = testtype8IF::copy_cold();
+  cold.set_fname("calibration v2");
+  cold.fcalib[1][0] = -1;
+  cold.fcalib[0][1] = 2;
+
+  // the hot and cold parts only write their own fields
+  auto version = testtype8IF::version();
+  testtype8IF::update_cold(cold);
+  CPPAssert((testtype8IF::version() > version), true);
+
+  auto full = testtype8IF::copy();
+  CPPAssert(full.fevent, 42);
+  CPPAssert(full.fweight, 0.25);
+  CPPAssert(full.get_ftag(), std::string("muon"));
+  CPPAssert(full.get_fname(), std::string("calibration v2"));
+  CPPAssert(full.fcalib[1][0], -1.);
+  CPPAssert(full.fcalib[0][1], 2.);
+}
@@ -0,0 +1,65 @@
+#define FORTMODGEN_EXPOSE_GLOBAL_INSTANCE
+#include "testmod.h"
+#include "test_asserts.h"
+
+#include "fmt/core.h"
+
+#include <cmath>
+
+using namespace FortMod;
+
+int main() {
+
+  // array of structs: every instance starts from the descriptor data
+  for (int i = 0; i < intpar; ++i) {
+    auto inst = testtype5IF::copy(i);
+    CPPAssert(inst.fid, 7);
+    CPPAssert(inst.fmass, 0.5);
+    CPPAssert(inst.fweights[1][0], 3.f);
+    CPPAssert(inst.fweights[2][1], 0.f);
+    CPPAssert(inst.get_flabel(), std::string(""));
+  }
+
+  testtype5IF::set_fid(1, 11);
+  testtype5IF::set_fweights_elem(1, 2, 1, -1);
+  testtype5IF::set_flabel(1, "electrons");
+  CPPAssert(testtype5IF::get_fid(0), 7);
+  CPPAssert(testtype5IF::get_fid(1), 11);
+  CPPAssert(testtype5IF::get_fweights_elem(0, 2, 1), 0.f);
+  CPPAssert(testtype5IF::get_flabel(1), std::string("electrons"));
+
+  // instances are contiguous in memory, as an array of C structs
+  CPPAssert(testtype5IF::const_instance(1).fweights[2][1], -1.f);
+  CPPAssert((&testtype5IF::const_instance(1) == &testtype5[1]), true);
+
+  {
+    testtype5IF::transaction tx(0);
+    tx.set_fmass(2.5);
+    tx.set_flabel("muons");
+  }
+  CPPAssert(testtype5IF::get_fmass(0), 2.5);
+  CPPAssert(testtype5IF::get_fmass(1), 0.5);
+  CPPAssert(testtype5IF::copy(0).get_flabel(), std::string("muons"));
+
+  auto inst = testtype5IF::copy(1);
+  inst.fid = 12;
+  testtype5IF::update(0, inst);
+  CPPAssert(testtype5IF::get_fid(0), 12);
+  CPPAssert(testtype5IF::get_flabel(0), std::string("electrons"));
+
+  testtype5IF::cached cache(1);
+  CPPAssert(cache.get().fid, 11);
+  CPPAssert(cache.stale(), false);
+
+  // struct of arrays: each field is an array with a leading instance index
+  for (int i = 0; i < 4; ++i) {
+    CPPAssert(testtype6IF::get_fhits_elem(i), 0);
+    CPPAssert(testtype6IF::get_fpos_elem(i, 2), 3.);
+  }
+  testtype6IF::set_fpos_elem(3, 0, -4);
+  testtype6IF::set_fhits_elem(2, 9);
+  auto soa = testtype6IF::copy();
+  CPPAssert(soa.fpos[3][0], -4.);
+  CPPAssert(soa.fpos[2][0], 1.);
+  CPPAssert(soa.fhits[2], 9);
+}
@@ -0,0 +1,33 @@
+#define FORTMODGEN_EXPOSE_GLOBAL_INSTANCE
+#include "testmod.h"
+#include "test_asserts.h"
+
+#include "fmt/core.h"
+
+#include <cmath>
+
+extern "C" {
+void fortwrite();
+}
+
+int main() {
+  fortwrite();
+
+  auto const &cinst1 = FortMod::testtype1IF::const_instance();
+  auto const &cinst2 = FortMod::testtype2IF::const_instance();
+
+  // references alias the Fortran global, so no copy is needed to read it
+  CPPAssert((&cinst1 == &testtype1), true);
+  CPPAssert(cinst1.fbool, true);
+  CPPAssert_float(cinst1.ffloat, 1.2345678);
+  CPPAssert(cinst1.get_fstr(), std::string("string from fortran"));
+  CPPAssert_float(cinst2.ffloat2a[4][2], 114);
+  CPPAssert(cinst2.fint3dim[3][2][1], 10023);
+
+  // writes through the reference are visible to the copy interface
+  FortMod::testtype1IF::instance().ffloat = 3.5;
+  FortMod::testtype2IF::instance().fint3dim[1][2][0] = -7;
+
+  CPPAssert_float(FortMod::testtype1IF::copy().ffloat, 3.5);
+  CPPAssert(FortMod::testtype2IF::copy().fint3dim[1][2][0], -7);
+}
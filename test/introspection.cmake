@@ -0,0 +1,53 @@
+# Checks that --print-outputs lists exactly the files that generation writes,
+# with and without split modules, and that the stamp and depfile are written.
+# Run with -DFORTMODGEN=<generator> -DDESCRIPTOR=<toml> -DWORKDIR=<dir>
+
+file(REMOVE_RECURSE ${WORKDIR})
+
+execute_process(COMMAND ${FORTMODGEN} --print-module-name -i ${DESCRIPTOR}
+  RESULT_VARIABLE status OUTPUT_VARIABLE modname
+  OUTPUT_STRIP_TRAILING_WHITESPACE)
+if((NOT status EQUAL 0) OR (NOT modname STREQUAL "testmod"))
+  message(FATAL_ERROR "--print-module-name gave \"${modname}\" instead of \"testmod\"")
+endif()
+
+foreach(mode single split)
+  set(split_args)
+  if(mode STREQUAL "split")
+    set(split_args --split-modules)
+  endif()
+  file(MAKE_DIRECTORY ${WORKDIR}/${mode})
+
+  execute_process(COMMAND ${FORTMODGEN} --print-outputs -i ${DESCRIPTOR}
+                          -o out ${split_args}
+    WORKING_DIRECTORY ${WORKDIR}/${mode} RESULT_VARIABLE status
+    OUTPUT_VARIABLE outputs OUTPUT_STRIP_TRAILING_WHITESPACE)
+  if(NOT status EQUAL 0)
+    message(FATAL_ERROR "--print-outputs failed in ${mode} mode")
+  endif()
+  file(GLOB written RELATIVE ${WORKDIR}/${mode} ${WORKDIR}/${mode}/*)
+  if(written)
+    message(FATAL_ERROR "--print-outputs wrote files: ${written}")
+  endif()
+
+  execute_process(COMMAND ${FORTMODGEN} -i ${DESCRIPTOR} -o out ${split_args}
+                          --stamp out.stamp --depfile out.d
+    WORKING_DIRECTORY ${WORKDIR}/${mode} RESULT_VARIABLE status OUTPUT_QUIET)
+  if(NOT status EQUAL 0)
+    message(FATAL_ERROR "fortmodgen failed in ${mode} mode")
+  endif()
+
+  string(REPLACE "\n" ";" outputs "${outputs}")
+  list(APPEND outputs out.stamp out.d)
+  list(SORT outputs)
+  file(GLOB written RELATIVE ${WORKDIR}/${mode} ${WORKDIR}/${mode}/*)
+  list(SORT written)
+  if(NOT outputs STREQUAL written)
+    message(FATAL_ERROR "${mode} mode wrote: ${written}\nbut listed: ${outputs}")
+  endif()
+
+  file(READ ${WORKDIR}/${mode}/out.d depfile)
+  if(NOT depfile STREQUAL "out.stamp: \\\n  ${DESCRIPTOR}\n")
+    message(FATAL_ERROR "unexpected depfile in ${mode} mode:\n${depfile}")
+  endif()
+endforeach()
@@ -0,0 +1,62 @@
+#include "testmod.h"
+#include "test_asserts.h"
+
+#include "fmt/core.h"
+
+#include <cstddef>
+
+using namespace FortMod;
+
+int main() {
+  // the Fortran compiler places every field where the C structs expect it
+  CPPAssert(check_testtype1_layout(), 0);
+  CPPAssert(check_testtype2_layout(), 0);
+  CPPAssert(check_testtype3_layout(), 0);
+  CPPAssert(check_testtype4_layout(), 0);
+  CPPAssert(check_testtype5_layout(), 0);
+  CPPAssert(check_testtype6_layout(), 0);
+  CPPAssert(check_testtype7_layout(), 0);
+  CPPAssert(check_testtype8_layout(), 0);
+  CPPAssert(check_testtype9_layout(), 0);
+  CPPAssert(check_testtype10_layout(), 0);
+
+  // packed types are ordered by decreasing alignment, keeping the descriptor
+  // order within each alignment
+  CPPAssert(offsetof(testtype7_t, fenergy), size_t(0));
+  CPPAssert(offsetof(testtype7_t, fmomentum), size_t(8));
+  CPPAssert(offsetof(testtype7_t, fcount), size_t(32));
+  CPPAssert(offsetof(testtype7_t, fflag), size_t(36));
+  CPPAssert(offsetof(testtype7_t, fvalid), size_t(37));
+  CPPAssert(sizeof(testtype7_t), size_t(40));
+
+  // the Fortran type uses the same order
+  auto inst = testtype7IF::copy();
+  CPPAssert(inst.fflag, true);
+  CPPAssert(inst.fenergy, 1.5);
+  CPPAssert(inst.fcount, 3);
+
+  inst.fvalid = true;
+  inst.fmomentum[2] = -2;
+  testtype7IF::update(inst);
+  CPPAssert(testtype7IF::get_fvalid(), true);
+  CPPAssert(testtype7IF::get_fmomentum_elem(2), -2.);
+  CPPAssert(testtype7IF::get_fflag(), true);
+
+  // over-aligned fields are preceded by explicit padding in both languages
+  CPPAssert(offsetof(testtype9_t, fvec), size_t(32));
+  CPPAssert(offsetof(testtype9_t, fmat), size_t(64));
+  CPPAssert(offsetof(testtype9_t, fflag), size_t(192));
+  CPPAssert(sizeof(testtype9_t), size_t(256));
+
+  testtype9IF::set_fmat_elem(3, 2, 11);
+  testtype9IF::set_fvec_elem(7, 5);
+  auto inst9 = testtype9IF::copy();
+  CPPAssert(inst9.fn, 8);
+  CPPAssert(inst9.fmat[3][2], 11.);
+  CPPAssert(inst9.fvec[7], 5.f);
+  CPPAssert(inst9.fflag, true);
+
+  inst9.fmat[0][1] = -3;
+  testtype9IF::update(inst9);
+  CPPAssert(testtype9IF::get_fmat_elem(0, 1), -3.);
+}
@@ -0,0 +1,86 @@
+# Checks that parameter expressions fold to literals with Fortran's kinds, that
+# expressions which cannot be folded are kept with a warning, and that field
+# extents which are not positive integer constants are rejected.
+# Run with -DFORTMODGEN=<generator> -DWORKDIR=<dir>
+
+file(REMOVE_RECURSE ${WORKDIR})
+file(MAKE_DIRECTORY ${WORKDIR})
+
+function(generate name parameters size)
+  file(WRITE ${WORKDIR}/${name}.toml "[module]
+name = \"${name}\"
+parameters = [
+  { name = \"ip\", type = \"integer\", value = 2 },
+  { name = \"fp\", type = \"float\", value = 0.1 },
+${parameters}
+]
+derivedtypes = [\"t\"]
+[module.t]
+fields = [ { name = \"a\", type = \"double\", size = ${size} } ]
+")
+  execute_process(COMMAND ${FORTMODGEN} -i ${name}.toml -o ${name}
+    WORKING_DIRECTORY ${WORKDIR} RESULT_VARIABLE status
+    OUTPUT_VARIABLE output ERROR_VARIABLE output)
+  set(status ${status} PARENT_SCOPE)
+  set(output "${output}" PARENT_SCOPE)
+endfunction()
+
+function(expect_in file text)
+  file(READ ${WORKDIR}/${file} content)
+  string(FIND "${content}" "${text}" at)
+  if(at EQUAL -1)
+    message(FATAL_ERROR "${file} does not contain \"${text}\"")
+  endif()
+endfunction()
+
+generate(folded "
+  { name = \"n\", type = \"integer\", value = \"2*ip + 7/2\" },
+  { name = \"m\", type = \"integer\", value = \"-(2**ip**2) + 20\" },
+  { name = \"x\", type = \"double\", value = \"(fp + ip**3) / 3\" },
+  { name = \"y\", type = \"double\", value = \"(0.1D0 + ip**3) / 3\" },
+  { name = \"r\", type = \"integer\", value = \"x\" },
+  { name = \"s\", type = \"float\", value = \"sqrt(fp)\" },
+  { name = \"one\", type = \"integer\", value = \"1**2000000000\" },
+  { name = \"sgn\", type = \"integer\", value = \"(-1)**2000000001\" },
+  { name = \"zero\", type = \"integer\", value = \"0**2000000000\" },
+" "[\"n\", \"m - 1\"]")
+if(NOT status EQUAL 0)
+  message(FATAL_ERROR "folding failed:\n${output}")
+endif()
+if(NOT output MATCHES "\"s\" = \"sqrt\\(fp\\)\" cannot be folded")
+  message(FATAL_ERROR "expected a warning for s, got:\n${output}")
+endif()
+expect_in(folded.f90 "parameter :: n = 7\n")
+expect_in(folded.f90 "parameter :: m = 4\n")
+# fp + ip**3 is a default real sum, only then converted to double
+expect_in(folded.f90 "parameter :: x = 2.7000000476837158D+00\n")
+expect_in(folded.f90 "parameter :: y = 2.6999999999999997D+00\n")
+expect_in(folded.f90 "parameter :: r = 2\n")
+expect_in(folded.f90 "parameter :: s = sqrt(fp)\n")
+expect_in(folded.f90 "parameter :: one = 1\n")
+expect_in(folded.f90 "parameter :: sgn = -1\n")
+expect_in(folded.f90 "parameter :: zero = 0\n")
+expect_in(folded.f90 "dimension(7, 3) :: a")
+expect_in(folded_structs.h "double a[3][7];")
+
+foreach(bad "\"n\"=which cannot be folded to a constant: parameter \"n\" is not"
+            "\"x\"=which is of non-integer type"
+            "\"ip - 2\"=has a dimension of extent 0"
+            "\"q\"=\"q\" is not a parameter declared before this one"
+            "\"ip/0\"=division by zero"
+            "\"ip**2000000000\"=integer overflow")
+  string(REPLACE "=" ";" bad "${bad}")
+  list(GET bad 0 size)
+  list(GET bad 1 message)
+  generate(rejected "
+  { name = \"n\", type = \"integer\", value = \"size(ip)\" },
+  { name = \"x\", type = \"double\", value = \"fp\" },
+" "[${size}]")
+  if(status EQUAL 0)
+    message(FATAL_ERROR "extent ${size} was accepted")
+  endif()
+  string(FIND "${output}" "${message}" at)
+  if(at EQUAL -1)
+    message(FATAL_ERROR "extent ${size} failed with:\n${output}")
+  endif()
+endforeach()
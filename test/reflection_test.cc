@@ -0,0 +1,73 @@
+#include "testmod.h"
+#include "test_asserts.h"
+
+#include "fmt/core.h"
+
+#include <cstring>
+#include <type_traits>
+
+using namespace FortMod;
+
+// the tables are usable in constant expressions
+static_assert(testtype2IF::nfields == 5, "unexpected testtype2 field count");
+static_assert(testtype2IF::fields[2].offset == offsetof(testtype2_t, ffloat2a),
+              "unexpected testtype2 field offset");
+static_assert(testtype2IF::fields[2].rank == 2, "unexpected testtype2 rank");
+static_assert(testtype8IF::fields[0].has(field_attribute::hot),
+              "unexpected testtype8 attributes");
+
+constexpr size_t member_bytes() {
+  size_t bytes = 0;
+  for (auto const &fi : testtype9IF::fields) {
+    bytes += fi.size;
+  }
+  return bytes;
+}
+static_assert(member_bytes() < sizeof(testtype9_t),
+              "padding members should not be listed");
+
+int main() {
+  auto const &f = testtype2IF::fields;
+  CPPAssert(std::string(f[2].name), std::string("ffloat2a"));
+  CPPAssert(std::string(f[2].ctype), std::string("float"));
+  CPPAssert(std::string(f[2].shape), std::string("[5][3]"));
+  CPPAssert(f[2].size, sizeof(float) * 15);
+  CPPAssert(f[4].has(field_attribute::configurable), true);
+  CPPAssert(f[4].has(field_attribute::hot), false);
+
+  CPPAssert(std::string(testtype1IF::fields[0].ctype), std::string("bool"));
+  CPPAssert(std::string(testtype1IF::fields[3].shape), std::string("[101]"));
+  CPPAssert(testtype1IF::fields[1].rank, 0);
+  CPPAssert(std::string(testtype1IF::fields[1].shape), std::string(""));
+
+  // generic code sees every member with its real type
+  testtype1_t inst{};
+  int nvisited = 0;
+  testtype1IF::for_each_field(inst, [&](field_info const &fi, auto &member) {
+    CPPAssert(fi.size, sizeof(member));
+    CPPAssert(size_t(reinterpret_cast<char *>(&member) -
+                     reinterpret_cast<char *>(&inst)),
+              fi.offset);
+    if constexpr (std::is_same_v<std::decay_t<decltype(member)>, double>) {
+      member = 4.5;
+    }
+    nvisited++;
+  });
+  CPPAssert(nvisited, testtype1IF::nfields);
+  CPPAssert(inst.fdouble, 4.5);
+
+  // a generic field-by-field diff
+  testtype1_t other = inst;
+  other.ffloat = 1;
+  std::string differs = "";
+  testtype1IF::for_each_field(
+      static_cast<testtype1_t const &>(inst),
+      [&](field_info const &fi, auto const &member) {
+        if (std::memcmp(&member, reinterpret_cast<char const *>(&other) +
+                                     fi.offset,
+                        fi.size)) {
+          differs += fi.name;
+        }
+      });
+  CPPAssert(differs, std::string("ffloat"));
+}
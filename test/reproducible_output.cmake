@@ -0,0 +1,39 @@
+# Generates the module twice from separate directories, once rendering the
+# types on one thread and once on several, and checks that the outputs are
+# byte-for-byte identical, with the types in descriptor order.
+# Run with -DFORTMODGEN=<generator> -DDESCRIPTOR=<toml> -DWORKDIR=<dir>
+
+set(a_threads 1)
+set(b_threads 8)
+foreach(run a b)
+  file(REMOVE_RECURSE ${WORKDIR}/${run})
+  file(MAKE_DIRECTORY ${WORKDIR}/${run})
+  execute_process(COMMAND ${FORTMODGEN} -i ${DESCRIPTOR} -o out
+                          -j ${${run}_threads}
+    WORKING_DIRECTORY ${WORKDIR}/${run}
+    RESULT_VARIABLE status OUTPUT_QUIET)
+  if(NOT status EQUAL 0)
+    message(FATAL_ERROR "fortmodgen failed in run ${run}")
+  endif()
+endforeach()
+
+foreach(ext .f90 .h _structs.h _c.h _strings.h _cpp.h _print.h _shm.c
+            _seqlock.c)
+  execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files
+    ${WORKDIR}/a/out${ext} ${WORKDIR}/b/out${ext}
+    RESULT_VARIABLE status)
+  if(NOT status EQUAL 0)
+    message(FATAL_ERROR "out${ext} differs between runs")
+  endif()
+endforeach()
+
+file(READ ${WORKDIR}/a/out_structs.h header)
+set(last -1)
+foreach(type testtype1 testtype2 testtype3 testtype4 testtype5 testtype6
+             testtype7 testtype8 testtype9 testtype10)
+  string(FIND "${header}" "struct ${type}_t {" pos)
+  if((pos EQUAL -1) OR (pos LESS last))
+    message(FATAL_ERROR "${type}_t is not declared in descriptor order")
+  endif()
+  set(last ${pos})
+endforeach()
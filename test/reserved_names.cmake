@@ -0,0 +1,41 @@
+# Checks that fields of types with explicit padding cannot take the names of
+# the padding members, in any case.
+# Run with -DFORTMODGEN=<generator> -DWORKDIR=<dir>
+
+file(REMOVE_RECURSE ${WORKDIR})
+file(MAKE_DIRECTORY ${WORKDIR})
+
+foreach(name pad_tail PAD_A pad_b)
+  file(WRITE ${WORKDIR}/padded.toml "[module]
+name = \"padded\"
+derivedtypes = [\"t\"]
+[module.t]
+fields = [
+  { name = \"a\", type = \"integer\" },
+  { name = \"b\", type = \"double\", size = 4, align = 32 },
+  { name = \"${name}\", type = \"integer\" },
+]
+")
+  execute_process(COMMAND ${FORTMODGEN} -i padded.toml -o padded
+    WORKING_DIRECTORY ${WORKDIR} RESULT_VARIABLE status
+    OUTPUT_VARIABLE output ERROR_VARIABLE output)
+  if(status EQUAL 0)
+    message(FATAL_ERROR "field ${name} was accepted")
+  endif()
+  if(NOT output MATCHES "Field \"${name}\" on type \"t\" has the name of a padding member")
+    message(FATAL_ERROR "field ${name} failed with:\n${output}")
+  endif()
+endforeach()
+
+# without over-aligned fields there is no padding member to clash with
+file(WRITE ${WORKDIR}/plain.toml "[module]
+name = \"plain\"
+derivedtypes = [\"t\"]
+[module.t]
+fields = [ { name = \"pad_tail\", type = \"integer\" } ]
+")
+execute_process(COMMAND ${FORTMODGEN} -i plain.toml -o plain
+  WORKING_DIRECTORY ${WORKDIR} RESULT_VARIABLE status OUTPUT_VARIABLE output)
+if(NOT status EQUAL 0)
+  message(FATAL_ERROR "pad_tail was rejected without explicit padding:\n${output}")
+endif()
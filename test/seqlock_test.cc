@@ -0,0 +1,120 @@
+#include "testmod.h"
+#include "test_asserts.h"
+
+#include "fmt/core.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace FortMod;
+
+extern "C" {
+void fortran_seqlock_writer(int n);
+int fortran_seqlock_reader(int n);
+}
+
+int const kNWrites = 20000;
+
+// every write leaves all elements of fdoublea equal to fcounter, so a reader
+// that observes anything else has seen a torn instance
+void writer() {
+  for (int k = 1; k <= kNWrites; ++k) {
+    if (k % 2) {
+      testtype3_t inst;
+      inst.fcounter = k;
+      for (auto &d : inst.fdoublea) {
+        d = k;
+      }
+      testtype3IF::update(inst);
+    } else {
+      testtype3IF::transaction tx;
+      tx.set_fcounter(k);
+      for (auto &d : tx.fdoublea()) {
+        d = k;
+      }
+    }
+  }
+}
+
+void reader(std::atomic<bool> const &done) {
+  while (!done) {
+    auto inst = testtype3IF::copy();
+    for (auto const &d : inst.fdoublea) {
+      CPPAssert(d, double(inst.fcounter));
+    }
+  }
+}
+
+int main() {
+  testtype3IF::update(testtype3_t{});
+
+  std::atomic<bool> done{false};
+  std::vector<std::thread> readers;
+  for (int i = 0; i < 4; ++i) {
+    readers.emplace_back(reader, std::cref(done));
+  }
+
+  writer();
+  done = true;
+  for (auto &r : readers) {
+    r.join();
+  }
+
+  CPPAssert(testtype3IF::get_fcounter(), kNWrites);
+  CPPAssert(testtype3IF::get_fdoublea_elem(63), double(kNWrites));
+
+  // the Fortran procedures take the same lock, so a Fortran writer does not
+  // tear the reads of C++ readers
+  testtype3IF::update(testtype3_t{});
+  done = false;
+  readers.clear();
+  for (int i = 0; i < 4; ++i) {
+    readers.emplace_back(reader, std::cref(done));
+  }
+  fortran_seqlock_writer(kNWrites);
+  done = true;
+  for (auto &r : readers) {
+    r.join();
+  }
+  CPPAssert(testtype3IF::get_fcounter(), kNWrites);
+
+  // and Fortran readers do not observe the writes of C++ half done
+  std::atomic<int> ntorn{0};
+  std::vector<std::thread> freaders;
+  for (int i = 0; i < 4; ++i) {
+    freaders.emplace_back(
+        [&ntorn]() { ntorn += fortran_seqlock_reader(5000); });
+  }
+  std::thread cwriter(writer);
+  for (auto &r : freaders) {
+    r.join();
+  }
+  cwriter.join();
+  CPPAssert(ntorn.load(), 0);
+
+  // concurrent modify() calls each read and write the whole instance, none
+  // of their increments may be lost
+  int const kNThreads = 4, kNIncrements = 2000;
+  testtype3IF::update(testtype3_t{});
+  auto version = testtype3IF::version();
+  std::vector<std::thread> writers;
+  for (int t = 0; t < kNThreads; ++t) {
+    writers.emplace_back([t]() {
+      for (int k = 0; k < kNIncrements; ++k) {
+        testtype3IF::modify([t](testtype3_t &inst) {
+          inst.fcounter++;
+          inst.fdoublea[t] += 1;
+        });
+      }
+    });
+  }
+  for (auto &w : writers) {
+    w.join();
+  }
+  CPPAssert(testtype3IF::get_fcounter(), kNThreads * kNIncrements);
+  for (int t = 0; t < kNThreads; ++t) {
+    CPPAssert(testtype3IF::get_fdoublea_elem(t), double(kNIncrements));
+  }
+  CPPAssert((testtype3IF::version() > version), true);
+}
@@ -0,0 +1,102 @@
+#include "testmod.h"
+#include "test_asserts.h"
+
+#include "fmt/core.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace FortMod;
+
+// the reader process sees the writer's instance, including modifications made
+// after it attached
+int reader(std::string const &name, int to_writer, int from_writer) {
+  CPPAssert(testtype10IF::attach(name), FORTMODGEN_IO_OK);
+  CPPAssert(testtype10IF::get_fthreshold(), 2.5);
+  CPPAssert(testtype10IF::const_instance().fchannels[3], 3);
+  CPPAssert(testtype10IF::get_fdetector(), std::string("tracker"));
+
+  auto version = testtype10IF::version();
+  char token = 0;
+  CPPAssert(write(to_writer, &token, 1), 1);
+  CPPAssert(read(from_writer, &token, 1), 1);
+
+  CPPAssert(testtype10IF::get_fthreshold(), 4.0);
+  CPPAssert((testtype10IF::version() > version), true);
+
+  testtype10IF::detach();
+  CPPAssert(testtype10IF::get_fthreshold(), 4.0);
+  return 0;
+}
+
+// a reader modifying the read-only mapping stops with an error instead of
+// faulting
+int reader_write(std::string const &name) {
+  CPPAssert(testtype10IF::attach(name), FORTMODGEN_IO_OK);
+  testtype10IF::set_fthreshold(1.0);
+  return 0;
+}
+
+int main() {
+  std::string name = fmt::format("/fortmodgen_shm_test_{}", getpid());
+
+  // before attaching the process-local instance is used
+  CPPAssert(testtype10IF::get_fthreshold(), 0.5);
+  CPPAssert(testtype10IF::attach(name), FORTMODGEN_IO_OPEN_FAILED);
+
+  testtype10IF::set_fthreshold(2.5);
+  CPPAssert(testtype10IF::attach(name, true), FORTMODGEN_IO_OK);
+  CPPAssert(testtype10IF::get_fthreshold(), 2.5);
+
+  auto &inst = testtype10IF::instance();
+  for (int i = 0; i < 16; ++i) {
+    inst.fchannels[i] = i;
+  }
+  testtype10IF::set_fdetector("tracker");
+
+  int to_writer[2], from_writer[2];
+  CPPAssert(pipe(to_writer), 0);
+  CPPAssert(pipe(from_writer), 0);
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    return reader(name, to_writer[1], from_writer[0]);
+  }
+
+  char token = 0;
+  CPPAssert(read(to_writer[0], &token, 1), 1);
+  testtype10IF::set_fthreshold(4.0);
+  CPPAssert(write(from_writer[1], &token, 1), 1);
+
+  int status = 0;
+  waitpid(pid, &status, 0);
+  CPPAssert(WIFEXITED(status), true);
+  CPPAssert(WEXITSTATUS(status), 0);
+
+  pid = fork();
+  if (pid == 0) {
+    return reader_write(name);
+  }
+  waitpid(pid, &status, 0);
+  CPPAssert(WIFEXITED(status), true);
+  CPPAssert(WEXITSTATUS(status), 1);
+  CPPAssert(testtype10IF::get_fthreshold(), 4.0);
+
+  testtype10IF::detach();
+  CPPAssert(testtype10IF::unlink(name), FORTMODGEN_IO_OK);
+  CPPAssert(testtype10IF::unlink(name), FORTMODGEN_IO_OPEN_FAILED);
+  CPPAssert(testtype10IF::attach(name), FORTMODGEN_IO_OPEN_FAILED);
+  CPPAssert(testtype10IF::get_fdetector(), std::string("tracker"));
+
+  // a reader that attaches between the writer's shm_open and ftruncate sees
+  // an empty segment, which it must refuse rather than map past its end
+  std::string empty = name + "_empty";
+  int fd = shm_open(empty.c_str(), O_RDWR | O_CREAT, 0600);
+  CPPAssert((fd >= 0), true);
+  close(fd);
+  CPPAssert(testtype10IF::attach(empty), FORTMODGEN_IO_LAYOUT_MISMATCH);
+  CPPAssert(testtype10IF::get_fdetector(), std::string("tracker"));
+  CPPAssert(testtype10IF::unlink(empty), FORTMODGEN_IO_OK);
+}
@@ -0,0 +1,87 @@
+#include "testmod.h"
+#include "test_asserts.h"
+
+#include "fmt/core.h"
+
+#include <fstream>
+#include <iterator>
+#include <string>
+
+using namespace FortMod;
+
+int main() {
+  testtype1IF::set_fdouble(6.25);
+  testtype1IF::set_fstr("checkpointed");
+  testtype2IF::set_fint3dim_elem(1, 2, 3, 99);
+  testtype5IF::set_fid(1, 5);
+
+  CPPAssert(testtype1IF::save("testtype1.snap"), FORTMODGEN_IO_OK);
+  CPPAssert(testtype2IF::save("testtype2.snap"), FORTMODGEN_IO_OK);
+  CPPAssert(testtype5IF::save("testtype5.snap"), FORTMODGEN_IO_OK);
+
+  testtype1IF::set_fdouble(0);
+  testtype1IF::set_fstr("overwritten");
+  testtype2IF::set_fint3dim_elem(1, 2, 3, 0);
+  testtype5IF::set_fid(1, 0);
+
+  // loading restores the exact bytes and flags the instance as modified
+  auto version = testtype1IF::version();
+  CPPAssert(testtype1IF::load("testtype1.snap"), FORTMODGEN_IO_OK);
+  CPPAssert((testtype1IF::version() > version), true);
+  CPPAssert(testtype1IF::get_fdouble(), 6.25);
+  CPPAssert(testtype1IF::get_fstr(), std::string("checkpointed"));
+
+  CPPAssert(testtype2IF::load("testtype2.snap"), FORTMODGEN_IO_OK);
+  CPPAssert(testtype2IF::get_fint3dim_elem(1, 2, 3), 99);
+
+  // instance arrays are saved and loaded as a whole
+  CPPAssert(testtype5IF::load("testtype5.snap"), FORTMODGEN_IO_OK);
+  CPPAssert(testtype5IF::get_fid(1), 5);
+  CPPAssert(testtype5IF::get_fid(0), 7);
+
+  // files for other layouts are refused and leave the instance untouched
+  testtype2IF::set_fint3dim_elem(1, 2, 3, -1);
+  CPPAssert(testtype2IF::load("testtype1.snap"),
+            FORTMODGEN_IO_LAYOUT_MISMATCH);
+  CPPAssert(testtype2IF::get_fint3dim_elem(1, 2, 3), -1);
+
+  CPPAssert(testtype2IF::load("does_not_exist.snap"),
+            FORTMODGEN_IO_OPEN_FAILED);
+
+  CPPAssert((testtype1IF::layout_hash != testtype2IF::layout_hash), true);
+
+  // a struct of arrays global is a single instance that spans all of them,
+  // so loading one must not write into the neighbouring globals
+  testtype6IF::set_fhits_elem(2, 11);
+  CPPAssert(testtype6IF::save("testtype6.snap"), FORTMODGEN_IO_OK);
+  std::ifstream soa("testtype6.snap", std::ios::binary | std::ios::ate);
+  CPPAssert(size_t(soa.tellg()), 4 * sizeof(int64_t) + sizeof(testtype6_t));
+  testtype6IF::set_fhits_elem(2, 0);
+  testtype5IF::set_fid(0, 123);
+  testtype2IF::set_ffloata_elem(0, 55);
+  CPPAssert(testtype6IF::load("testtype6.snap"), FORTMODGEN_IO_OK);
+  CPPAssert(testtype6IF::get_fhits_elem(2), 11);
+  CPPAssert(testtype5IF::get_fid(0), 123);
+  CPPAssert(testtype2IF::get_ffloata_elem(0), 55);
+
+  // a truncated file is an I/O error that leaves the instance untouched
+  {
+    std::ifstream in("testtype1.snap", std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(in)),
+                      std::istreambuf_iterator<char>());
+    std::ofstream("truncated.snap", std::ios::binary)
+        << bytes.substr(0, bytes.size() / 2);
+  }
+  testtype1IF::set_fdouble(-1);
+  version = testtype1IF::version();
+  CPPAssert(testtype1IF::load("truncated.snap"), FORTMODGEN_IO_ERROR);
+  CPPAssert(testtype1IF::get_fdouble(), -1);
+  CPPAssert(testtype1IF::version(), version);
+
+  // seqlocked types are copied under the lock and written outside it
+  testtype3IF::set_fcounter(17);
+  CPPAssert(testtype3IF::save("testtype3.snap"), FORTMODGEN_IO_OK);
+  testtype3IF::set_fcounter(0);
+  CPPAssert(testtype3IF::load("testtype3.snap"), FORTMODGEN_IO_OK);
+  CPPAssert(testtype3IF::get_fcounter(), 17);
+}
@@ -0,0 +1,43 @@
+# Generates the test module with split modules, edits one field of testtype3
+# and regenerates. Only the testtype3 module and the headers whose content
+# changed may be rewritten, every other module keeps its bytes.
+# Run with -DFORTMODGEN=<generator> -DDESCRIPTOR=<toml> -DWORKDIR=<dir>
+
+file(REMOVE_RECURSE ${WORKDIR})
+file(MAKE_DIRECTORY ${WORKDIR})
+configure_file(${DESCRIPTOR} ${WORKDIR}/tm.toml COPYONLY)
+
+function(generate)
+  execute_process(COMMAND ${FORTMODGEN} -i tm.toml -o tm --split-modules
+    WORKING_DIRECTORY ${WORKDIR} RESULT_VARIABLE status
+    OUTPUT_VARIABLE output)
+  if(NOT status EQUAL 0)
+    message(FATAL_ERROR "fortmodgen failed:\n${output}")
+  endif()
+  set(output "${output}" PARENT_SCOPE)
+endfunction()
+
+generate()
+
+file(READ ${WORKDIR}/tm.toml descriptor)
+string(REPLACE "{ name = \"fcounter\",  type = \"integer\","
+  "{ name = \"fcounter\",  type = \"integer\", comment = \"events seen\","
+  edited "${descriptor}")
+if(edited STREQUAL descriptor)
+  message(FATAL_ERROR "the fcounter field of testtype3 was not found")
+endif()
+file(WRITE ${WORKDIR}/tm.toml "${edited}")
+
+generate()
+
+string(REGEX MATCHALL "Wrote: [^\n]*" wrote "${output}")
+string(REPLACE "Wrote: " "" wrote "${wrote}")
+foreach(f ${wrote})
+  if(f MATCHES "\\.f90$" AND NOT f STREQUAL "tm_testtype3.f90")
+    message(FATAL_ERROR "editing testtype3 rewrote ${f}, all rewritten: ${wrote}")
+  endif()
+endforeach()
+list(FIND wrote tm_testtype3.f90 at)
+if(at EQUAL -1)
+  message(FATAL_ERROR "editing testtype3 did not rewrite tm_testtype3.f90")
+endif()
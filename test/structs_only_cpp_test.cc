@@ -0,0 +1,16 @@
+#include "testmod_structs.h"
+
+#include <cstdio>
+
+// a C++ translation unit can use the structs and their views without the
+// interface, string or print headers
+int main() {
+  testtype2_t inst{};
+  inst.view_fint3dim()(2, 3, 4) = 5;
+  if ((inst.fint3dim[3][2][1] != 5) ||
+      (testtype2_t{}.view_ffloat2a().size() != 15)) {
+    std::printf("ASSERT[FAILED]: unexpected testtype2_t from C++\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,17 @@
+#include "testmod_structs.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// the structs header is usable from C without the Fortran interface
+int main() {
+  struct testtype2_t inst;
+  memset(&inst, 0, sizeof(inst));
+  inst.fint3dim[3][2][1] = 5;
+  if ((sizeof(inst.fint3dim) != (24 * sizeof(int))) || (intpar != 2) ||
+      (inst.fint3dim[3][2][1] != 5)) {
+    printf("ASSERT[FAILED]: unexpected testtype2_t from C\n");
+    return 1;
+  }
+  return 0;
+}
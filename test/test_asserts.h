@@ -0,0 +1,29 @@
+#pragma once
+
+#include "fmt/core.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+// Assertions shared by the C++ tests, a failure prints the expression and
+// both values and aborts
+
+#define CPPAssert(field, Expected)                                             \
+  if (field != Expected) {                                                     \
+    std::cout << fmt::format("ASSERT[FAILED]: {}:{}\n\t{}, Read: {} != {}.",   \
+                             __FILE__, __LINE__, #field, field, Expected)      \
+              << std::endl;                                                    \
+    abort();                                                                   \
+  }
+
+#define CPPAssert_float(field, Expected)                                       \
+  if (std::fabs(field - float(Expected)) > 1E-7) {                             \
+    std::cout << fmt::format(                                                  \
+                     "ASSERT[FAILED]: {}:{}\n\tfloat {}, Read: {:.8E} != "     \
+                     "{:.8E}. Difference = {:.8E}",                            \
+                     __FILE__, __LINE__, #field, field, float(Expected),       \
+                     std::fabs(field - Expected))                              \
+              << std::endl;                                                    \
+    abort();                                                                   \
+  }
@@ -0,0 +1,31 @@
+#include "testmod.h"
+#include "test_asserts.h"
+
+#include "fmt/core.h"
+
+#include <thread>
+
+using namespace FortMod;
+
+int main() {
+  testtype4IF::set_fevent(1);
+  testtype4IF::instance().fscratch[3] = 1.5;
+
+  std::thread worker([]() {
+    // each thread starts from the initial data of the type
+    CPPAssert(testtype4IF::get_fevent(), -1);
+    CPPAssert(testtype4IF::const_instance().fscratch[3], 0);
+
+    testtype4_t inst = testtype4IF::copy();
+    inst.fevent = 2;
+    testtype4IF::update(inst);
+    testtype4IF::instance().fscratch[3] = 2.5;
+
+    CPPAssert(testtype4IF::copy().fevent, 2);
+    CPPAssert(testtype4IF::get_fscratch_elem(3), 2.5);
+  });
+  worker.join();
+
+  CPPAssert(testtype4IF::get_fevent(), 1);
+  CPPAssert(testtype4IF::copy().fscratch[3], 1.5);
+}
@@ -0,0 +1,60 @@
+#define FORTMODGEN_EXPOSE_GLOBAL_INSTANCE
+#include "testmod.h"
+#include "test_asserts.h"
+
+#include "fmt/core.h"
+
+#include <numeric>
+
+using namespace FortMod;
+
+int main() {
+  // fint3dim is integer, dimension(2,3,4) in Fortran and int[4][3][2] in C
+  auto inst = testtype2IF::copy();
+  auto v = inst.view_fint3dim();
+  CPPAssert(v.rank(), 3);
+  CPPAssert(v.extent(0), 2);
+  CPPAssert(v.extent(2), 4);
+  CPPAssert(v.size(), size_t(24));
+
+  std::iota(v.begin(), v.end(), 0);
+  for (int k = 1; k <= 4; ++k) {
+    for (int j = 1; j <= 3; ++j) {
+      for (int i = 1; i <= 2; ++i) {
+        int expected = (i - 1) + 2 * (j - 1) + 6 * (k - 1);
+        CPPAssert(v(i, j, k), expected);
+        CPPAssert(v.at(k - 1, j - 1, i - 1), expected);
+        CPPAssert(inst.fint3dim[k - 1][j - 1][i - 1], expected);
+      }
+    }
+  }
+
+  // fint3dim(:,:,3) and fint3dim(:,2,3)
+  auto plane = v.slice(3);
+  CPPAssert(plane.rank(), 2);
+  CPPAssert(plane(2, 3), v(2, 3, 3));
+  CPPAssert(plane.slice(2)(1), v(1, 2, 3));
+  CPPAssert((plane.data() == &inst.fint3dim[2][0][0]), true);
+
+  // fint3dim(:,:,2:3)
+  auto sec = v.section(2, 3);
+  CPPAssert(sec.extent(2), 2);
+  CPPAssert(sec.size(), size_t(12));
+  CPPAssert(sec(1, 1, 1), v(1, 1, 2));
+  CPPAssert(std::accumulate(sec.begin(), sec.end(), 0),
+            std::accumulate(v.begin() + 6, v.begin() + 18, 0));
+
+  // views of a const instance are read-only
+  testtype2_t const &cinst = inst;
+  auto cv = cinst.view_ffloat2a();
+  static_assert(std::is_same<decltype(cv(1, 1)), float const &>::value,
+                "const instances give const views");
+  CPPAssert(cv(3, 2), inst.ffloat2a[1][2]);
+
+  // views of the global instance write straight to Fortran memory
+  testtype2IF::update(inst);
+  auto gv = testtype2IF::instance().view_ffloat2a();
+  gv(3, 2) = 42;
+  testtype2IF::touch();
+  CPPAssert(testtype2IF::get_ffloat2a_elem(1, 2), 42.f);
+}